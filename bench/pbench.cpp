@@ -0,0 +1,577 @@
+//Headless benchmark for the particle physics
+//Steps a ParticleWorld full of particles falling into a box and reports how many steps per second it manages
+//No graphics are involved so this runs anywhere the physics library builds
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "coreMath.h"
+#include "pworld.h"
+#include "collision.h"
+#include "psegments.h"
+#include "psnapshot.h"
+#include "pgrid.h"
+#include "psweep.h"
+
+//Contact generator for the four walls of a box centred on the origin
+//A batch generator, so the world hands it spans of particles and can run them in parallel
+class BoxWalls : public ParticleBatchContactGenerator
+{
+public:
+	float halfSize;
+	float restitution;
+
+	BoxWalls(ParticleWorld *world, float halfSize, float restitution)
+		: ParticleBatchContactGenerator(&world->getParticles()), halfSize(halfSize), restitution(restitution) {}
+
+	virtual unsigned addContactBatch(Particle *const *batch, unsigned count, ParticleContact *contact, unsigned limit) const
+	{
+		if (count == 0) return 0;
+		const ParticleStore &store = *batch[0]->getStore();
+		const Vector2 normals[4] = { Vector2(1, 0), Vector2(-1, 0), Vector2(0, 1), Vector2(0, -1) };
+
+		unsigned used = 0;
+		for (unsigned k = 0; k < count; k++)
+		{
+			unsigned i = batch[k]->getIndex();
+			float r = store.radius[i];
+			float depth[4] = {
+				r - (store.positionX[i] + halfSize),
+				r - (halfSize - store.positionX[i]),
+				r - (store.positionY[i] + halfSize),
+				r - (halfSize - store.positionY[i])
+			};
+			for (unsigned w = 0; w < 4; w++)
+			{
+				if (depth[w] <= 0) continue;
+				if (used == limit) return used;
+				contact->particle[0] = batch[k];
+				contact->particle[1] = 0;
+				contact->contactNormal = normals[w];
+				contact->restitution = restitution;
+				contact->penetration = depth[w];
+				contact++;
+				used++;
+			}
+		}
+		return used;
+	}
+};
+
+//Fills the world with particles at random spots in the box, the same ones for the same seed
+static void addParticles(ParticleWorld &world, unsigned count, float halfSize, unsigned seed)
+{
+	srand(seed);
+	world.getParticleStore().reserve(count);
+	for (unsigned i = 0; i < count; i++)
+	{
+		Particle *particle = world.createParticle();
+		float x = -halfSize + 2 * halfSize * (rand() / (float)RAND_MAX);
+		float y = -halfSize + 2 * halfSize * (rand() / (float)RAND_MAX);
+		float mass = 1.0f + 9.0f * (rand() / (float)RAND_MAX);
+		particle->setPosition(x, y);
+		particle->setVelocity(0, 0);
+		particle->setAcceleration(Vector2::GRAVITY * 20.0f);
+		particle->setDamping(0.99f);
+		particle->setMass(mass);
+		particle->setRadius(0.5f + mass / 10.0f);
+	}
+}
+
+//Self check: the indexed heap resolver picks contacts in the same order as the sequential one,
+//so two worlds stepped side by side with the two resolvers must stay bit for bit the same
+static bool checkHeapResolver()
+{
+	const unsigned count = 500;
+	float halfSize = sqrt((float)count * 3.0f) * 1.5f;
+	ParticleWorld sequential(256), indexed(256);
+	sequential.setResolverMode(ParticleWorld::RESOLVE_SEQUENTIAL);
+	indexed.setResolverMode(ParticleWorld::RESOLVE_INDEXED);
+
+	ParticleWorld *worlds[2] = { &sequential, &indexed };
+	ParticleCollisionGenerator sequentialCollisions(&sequential, 0.5f), indexedCollisions(&indexed, 0.5f);
+	BoxWalls sequentialWalls(&sequential, halfSize, 0.5f), indexedWalls(&indexed, halfSize, 0.5f);
+	sequential.getContactGenerators().push_back(&sequentialCollisions);
+	sequential.getContactGenerators().push_back(&sequentialWalls);
+	indexed.getContactGenerators().push_back(&indexedCollisions);
+	indexed.getContactGenerators().push_back(&indexedWalls);
+	for (unsigned w = 0; w < 2; w++)
+	{
+		worlds[w]->setThreadCount(1);
+		addParticles(*worlds[w], count, halfSize, 1);
+	}
+
+	for (unsigned s = 0; s < 100; s++)
+	{
+		sequential.runPhysics(0.01f);
+		indexed.runPhysics(0.01f);
+
+		const ParticleStore &a = sequential.getParticleStore();
+		const ParticleStore &b = indexed.getParticleStore();
+		size_t bytes = count * sizeof(float);
+		if (memcmp(&a.positionX[0], &b.positionX[0], bytes) || memcmp(&a.positionY[0], &b.positionY[0], bytes) ||
+			memcmp(&a.velocityX[0], &b.velocityX[0], bytes) || memcmp(&a.velocityY[0], &b.velocityY[0], bytes))
+		{
+			printf("check heap resolver: worlds differ after step %u\n", s + 1);
+			return false;
+		}
+	}
+	printf("check heap resolver: ok, 100 steps identical to the sequential resolver\n");
+	return true;
+}
+
+//Self check: readers on other threads must only ever see whole snapshots, never one the publisher is
+//part way through, and never an older one after a newer. Worth running in a ThreadSanitizer build too.
+static bool checkSnapshots()
+{
+	const unsigned count = 256;
+	const unsigned frames = 20000;
+	const unsigned readerCount = 3;
+	ParticleStore store;
+	for (unsigned i = 0; i < count; i++) store.create();
+
+	ParticleSnapshotBuffer buffer;
+	std::atomic<bool> finished(false);
+	std::atomic<unsigned> started(0);
+	std::atomic<unsigned> torn(0);
+	std::atomic<unsigned> reads(0);
+
+	//Every particle of frame f sits at (f, f), so a snapshot is whole if all its particles agree with its stamp
+	std::vector<std::thread> readers;
+	for (unsigned r = 0; r < readerCount; r++)
+	{
+		readers.push_back(std::thread([&]()
+		{
+			unsigned lastFrame = 0;
+			started++;
+			while (!finished.load())
+			{
+				const ParticleSnapshot *snapshot = buffer.acquire();
+				if (!snapshot) continue;
+
+				float stamp = (float)snapshot->stamp;
+				bool whole = snapshot->frame >= lastFrame && snapshot->size() == count;
+				for (unsigned i = 0; whole && i < count; i++)
+				{
+					whole = snapshot->positionX[i] == stamp && snapshot->positionY[i] == stamp &&
+						snapshot->previousX[i] == snapshot->previousX[0] && snapshot->previousX[i] <= stamp;
+				}
+				if (!whole) torn++;
+				lastFrame = snapshot->frame;
+				buffer.release(snapshot);
+				reads++;
+
+				//Take turns with the publisher, even on a single core
+				std::this_thread::yield();
+			}
+		}));
+	}
+
+	//Publish only once every reader is going, so the frames really are read while they are written
+	while (started.load() < readerCount) std::this_thread::yield();
+	for (unsigned f = 1; f <= frames; f++)
+	{
+		for (unsigned i = 0; i < count; i++)
+		{
+			store.positionX[i] = (float)f;
+			store.positionY[i] = (float)f;
+		}
+		buffer.publish(store, f);
+		std::this_thread::yield();
+	}
+	finished = true;
+	for (unsigned r = 0; r < readerCount; r++) readers[r].join();
+
+	unsigned accounted = buffer.getPublishedCount() + buffer.getSkippedCount();
+	if (torn != 0 || accounted != frames)
+	{
+		printf("check snapshots: %u torn or out of order reads, %u of %u frames accounted for\n",
+			(unsigned)torn, accounted, frames);
+		return false;
+	}
+	printf("check snapshots: ok, %u frames published, %u skipped, %u whole reads by %u readers\n",
+		buffer.getPublishedCount(), buffer.getSkippedCount(), (unsigned)reads, readerCount);
+	return true;
+}
+
+//Orders pairs so two lists of the same pairs compare equal whatever order they were found in
+static bool pairLess(const ParticlePair &a, const ParticlePair &b)
+{
+	if (a.index[0] != b.index[0]) return a.index[0] < b.index[0];
+	return a.index[1] < b.index[1];
+}
+
+//Self check: the grid and the sweep must find exactly the same pairs, frame after frame as the particles move
+static bool checkBroadphases()
+{
+	const unsigned count = 2000;
+	float halfSize = sqrt((float)count * 3.0f) * 1.5f;
+	ParticleWorld world(256);
+	world.setResolverMode(ParticleWorld::RESOLVE_COLOURED);
+	ParticleCollisionGenerator collisions(&world, 0.5f);
+	BoxWalls walls(&world, halfSize, 0.5f);
+	world.getContactGenerators().push_back(&collisions);
+	world.getContactGenerators().push_back(&walls);
+	addParticles(world, count, halfSize, 2);
+
+	ParticleGrid grid;
+	ParticleSweepAndPrune sweep;
+	ParticleGrid::ParticlePairs gridPairs, sweepPairs;
+	unsigned long long total = 0;
+	for (unsigned s = 0; s < 200; s++)
+	{
+		world.runPhysics(0.01f);
+
+		grid.build(world.getParticleStore());
+		grid.findPairs(gridPairs);
+		sweep.update(world.getParticleStore());
+		sweep.findPairs(sweepPairs);
+		std::sort(gridPairs.begin(), gridPairs.end(), pairLess);
+		std::sort(sweepPairs.begin(), sweepPairs.end(), pairLess);
+
+		bool same = gridPairs.size() == sweepPairs.size();
+		for (unsigned i = 0; same && i < gridPairs.size(); i++)
+		{
+			same = gridPairs[i].index[0] == sweepPairs[i].index[0] && gridPairs[i].index[1] == sweepPairs[i].index[1];
+		}
+		if (!same)
+		{
+			printf("check broadphases: step %u, grid found %u pairs and sweep %u, not the same ones\n",
+				s + 1, (unsigned)gridPairs.size(), (unsigned)sweepPairs.size());
+			return false;
+		}
+		total += gridPairs.size();
+	}
+	printf("check broadphases: ok, grid and sweep agree on %llu pairs over 200 steps\n", total);
+	return true;
+}
+
+//Self check: a frame split into short steps by adaptive stepping must apply the same force as one taken
+//whole, so a particle pushed by a constant force ends each frame with the same velocity either way
+static bool checkSplitForces()
+{
+	ParticleWorld whole(16), split(16);
+	split.setAdaptiveStepping(0.5f);
+	ParticleWorld *worlds[2] = { &whole, &split };
+	Particle *particles[2];
+	for (unsigned w = 0; w < 2; w++)
+	{
+		particles[w] = worlds[w]->createParticle();
+		particles[w]->setMass(2);
+		particles[w]->setRadius(1);
+		particles[w]->setDamping(1);
+		particles[w]->setVelocity(100, 0);
+	}
+
+	unsigned mostSteps = 0;
+	for (unsigned s = 0; s < 20; s++)
+	{
+		for (unsigned w = 0; w < 2; w++)
+		{
+			particles[w]->addForce(Vector2(0, 10));
+			worlds[w]->runPhysics(0.1f);
+		}
+		if (split.getStepCount() > mostSteps) mostSteps = split.getStepCount();
+
+		Vector2 a = particles[0]->getVelocity();
+		Vector2 b = particles[1]->getVelocity();
+		if (fabs(a.x - b.x) > 1e-3f || fabs(a.y - b.y) > 1e-3f)
+		{
+			printf("check split forces: frame %u ends at (%g, %g) whole and (%g, %g) split into %u steps\n",
+				s + 1, a.x, a.y, b.x, b.y, split.getStepCount());
+			return false;
+		}
+	}
+	if (mostSteps < 2)
+	{
+		printf("check split forces: the frames were never split\n");
+		return false;
+	}
+	printf("check split forces: ok, frames split into up to %u steps keep their force\n", mostSteps);
+	return true;
+}
+
+//Self check: contacts generated on the worker threads must come out in the same order, with the same
+//values, as ones generated on one thread, and a contact limit must drop the same ones from both
+static bool checkParallelContacts()
+{
+	const unsigned count = 1000;
+	const unsigned steps = 50;
+	float halfSize = sqrt((float)count * 3.0f) * 1.5f;
+	const unsigned limits[2] = { 0, 100 };
+	for (unsigned l = 0; l < 2; l++)
+	{
+		ParticleWorld sequential(256), parallel(256);
+		parallel.setParallelContactGeneration(true);
+		ParticleWorld *worlds[2] = { &sequential, &parallel };
+		ParticleCollisionGenerator sequentialCollisions(&sequential, 0.5f), parallelCollisions(&parallel, 0.5f);
+		BoxWalls sequentialWalls(&sequential, halfSize, 0.5f), parallelWalls(&parallel, halfSize, 0.5f);
+		sequential.getContactGenerators().push_back(&sequentialCollisions);
+		sequential.getContactGenerators().push_back(&sequentialWalls);
+		parallel.getContactGenerators().push_back(&parallelCollisions);
+		parallel.getContactGenerators().push_back(&parallelWalls);
+		for (unsigned w = 0; w < 2; w++)
+		{
+			worlds[w]->setResolverMode(ParticleWorld::RESOLVE_COLOURED);
+			worlds[w]->setThreadCount(4);
+			worlds[w]->setContactLimit(limits[l]);
+			addParticles(*worlds[w], count, halfSize, 3);
+		}
+
+		unsigned long long total = 0;
+		unsigned dropped = 0;
+		for (unsigned s = 0; s < steps; s++)
+		{
+			sequential.runPhysics(0.01f);
+			parallel.runPhysics(0.01f);
+
+			const ParticleContactArena &a = sequential.getContactArena();
+			const ParticleContactArena &b = parallel.getContactArena();
+			bool same = a.getUsed() == b.getUsed();
+			for (unsigned i = 0; same && i < a.getUsed(); i++)
+			{
+				const ParticleContact &x = *a.at(i);
+				const ParticleContact &y = *b.at(i);
+				for (unsigned p = 0; p < 2; p++)
+				{
+					same = same && !x.particle[p] == !y.particle[p] &&
+						(!x.particle[p] || x.particle[p]->getIndex() == y.particle[p]->getIndex());
+				}
+				same = same && x.contactNormal.x == y.contactNormal.x && x.contactNormal.y == y.contactNormal.y &&
+					x.penetration == y.penetration && x.restitution == y.restitution;
+			}
+			if (!same)
+			{
+				printf("check parallel contacts: step %u with limit %u, %u contacts on one thread and %u on several, not the same ones\n",
+					s + 1, limits[l], a.getUsed(), b.getUsed());
+				return false;
+			}
+			total += a.getUsed();
+			dropped += a.getDroppedLastFrame();
+		}
+		if (limits[l] && !dropped)
+		{
+			printf("check parallel contacts: the limit of %u never dropped a contact\n", limits[l]);
+			return false;
+		}
+		printf("check parallel contacts: ok, %llu contacts over %u steps with limit %u, %u dropped\n",
+			total, steps, limits[l], dropped);
+	}
+	return true;
+}
+
+static void usage()
+{
+	printf("usage: pbench [--particles N] [--steps N] [--threads N] [--dt seconds]\n"
+		"              [--resolver sequential|indexed|coloured|jacobi|islands] [--parallel-contacts]\n"
+		"              [--broadphase grid|sweep] [--segments N] [--contact-limit N]\n"
+		"              [--integrator euler|symplectic|verlet] [--step impulses|positions] [--substeps N]\n"
+		"              [--cfl fraction]\n"
+		"              [--warm-start] [--sleep]\n"
+		"              [--profile trace.json]\n"
+		"       pbench --check\n");
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned particleCount = 10000;
+	unsigned steps = 200;
+	unsigned threads = 1;
+	unsigned segmentCount = 0;
+	unsigned contactLimit = 0;
+	float duration = 0.01f;
+	bool parallelContacts = false;
+	bool warmStart = false;
+	bool sleep = false;
+	const char *resolverName = "coloured";
+	const char *broadphaseName = "grid";
+	const char *integratorName = "euler";
+	const char *stepName = "impulses";
+	unsigned substeps = 8;
+	float stepFraction = 0;
+	const char *profileName = 0;
+
+	//The self checks run on their own, with scenes of their own
+	if (argc == 2 && !strcmp(argv[1], "--check"))
+	{
+		bool passed = checkHeapResolver();
+		passed = checkSnapshots() && passed;
+		passed = checkBroadphases() && passed;
+		passed = checkSplitForces() && passed;
+		passed = checkParallelContacts() && passed;
+		return passed ? 0 : 1;
+	}
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "--particles") && i + 1 < argc) particleCount = (unsigned)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--steps") && i + 1 < argc) steps = (unsigned)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--threads") && i + 1 < argc) threads = (unsigned)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--segments") && i + 1 < argc) segmentCount = (unsigned)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--contact-limit") && i + 1 < argc) contactLimit = (unsigned)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--dt") && i + 1 < argc) duration = (float)atof(argv[++i]);
+		else if (!strcmp(argv[i], "--resolver") && i + 1 < argc) resolverName = argv[++i];
+		else if (!strcmp(argv[i], "--broadphase") && i + 1 < argc) broadphaseName = argv[++i];
+		else if (!strcmp(argv[i], "--integrator") && i + 1 < argc) integratorName = argv[++i];
+		else if (!strcmp(argv[i], "--step") && i + 1 < argc) stepName = argv[++i];
+		else if (!strcmp(argv[i], "--substeps") && i + 1 < argc) substeps = (unsigned)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--cfl") && i + 1 < argc) stepFraction = (float)atof(argv[++i]);
+		else if (!strcmp(argv[i], "--parallel-contacts")) parallelContacts = true;
+		else if (!strcmp(argv[i], "--warm-start")) warmStart = true;
+		else if (!strcmp(argv[i], "--sleep")) sleep = true;
+		else if (!strcmp(argv[i], "--profile") && i + 1 < argc) profileName = argv[++i];
+		else { usage(); return 1; }
+	}
+
+	ParticleWorld::ResolverMode mode;
+	if (!strcmp(resolverName, "sequential")) mode = ParticleWorld::RESOLVE_SEQUENTIAL;
+	else if (!strcmp(resolverName, "indexed")) mode = ParticleWorld::RESOLVE_INDEXED;
+	else if (!strcmp(resolverName, "coloured")) mode = ParticleWorld::RESOLVE_COLOURED;
+	else if (!strcmp(resolverName, "jacobi")) mode = ParticleWorld::RESOLVE_JACOBI;
+	else if (!strcmp(resolverName, "islands")) mode = ParticleWorld::RESOLVE_ISLANDS;
+	else { usage(); return 1; }
+
+	ParticleWorld::BroadphaseMode broadphase;
+	if (!strcmp(broadphaseName, "grid")) broadphase = ParticleWorld::BROADPHASE_GRID;
+	else if (!strcmp(broadphaseName, "sweep")) broadphase = ParticleWorld::BROADPHASE_SWEEP;
+	else { usage(); return 1; }
+
+	ParticleWorld::IntegratorMode integrator;
+	if (!strcmp(integratorName, "euler")) integrator = ParticleWorld::INTEGRATE_EULER;
+	else if (!strcmp(integratorName, "symplectic")) integrator = ParticleWorld::INTEGRATE_SYMPLECTIC_EULER;
+	else if (!strcmp(integratorName, "verlet")) integrator = ParticleWorld::INTEGRATE_VERLET;
+	else { usage(); return 1; }
+
+	ParticleWorld::StepMode stepMode;
+	if (!strcmp(stepName, "impulses")) stepMode = ParticleWorld::STEP_IMPULSES;
+	else if (!strcmp(stepName, "positions")) stepMode = ParticleWorld::STEP_POSITIONS;
+	else { usage(); return 1; }
+
+	//Keep the density the same whatever the particle count, about a quarter of the box covered
+	float halfSize = sqrt((float)particleCount * 3.0f) * 1.5f;
+
+	//The contact arena starts small and grows to whatever the scene needs
+	ParticleWorld world(256);
+	world.setContactLimit(contactLimit);
+	world.setWarmStarting(warmStart);
+	world.setSleeping(sleep);
+
+	//The scene runs at twenty times normal gravity, so the pile settles harder; count anything
+	//slower on average than a single step of that gravity as at rest
+	float restSpeed = Vector2::GRAVITY.magnitude() * 20.0f * duration;
+	world.setSleepEnergy(0.5f * restSpeed * restSpeed);
+	world.setThreadCount(threads);
+	world.setResolverMode(mode);
+	world.setBroadphaseMode(broadphase);
+	world.setIntegratorMode(integrator);
+	world.setStepMode(stepMode);
+	world.setSubsteps(substeps);
+	world.setAdaptiveStepping(stepFraction);
+	world.setParallelContactGeneration(parallelContacts);
+
+	addParticles(world, particleCount, halfSize, 1);
+
+	ParticleCollisionGenerator collisions(&world, 0.5f);
+	BoxWalls walls(&world, halfSize, 0.5f);
+	world.getContactGenerators().push_back(&collisions);
+	world.getContactGenerators().push_back(&walls);
+
+	//Optional level geometry: a zig-zag floor across the lower part of the box
+	ParticleSegmentGenerator segments(&world, 0.5f);
+	for (unsigned i = 0; i < segmentCount; i++)
+	{
+		float step = 2 * halfSize / segmentCount;
+		float x = -halfSize + i * step;
+		float y = -halfSize * 0.5f + ((i & 1) ? 1.0f : -1.0f);
+		float nextY = -halfSize * 0.5f + ((i & 1) ? -1.0f : 1.0f);
+		segments.addSegment(Vector2(x, y), Vector2(x + step, nextY));
+	}
+	segments.build();
+	if (segmentCount) world.getContactGenerators().push_back(&segments);
+
+	//Let the particles settle into the simulation before timing
+	unsigned warmup = steps / 10;
+	for (unsigned s = 0; s < warmup; s++) world.runPhysics(duration);
+
+	//Trace the timed steps only, the room for them is reserved up front
+	if (profileName) world.getProfiler().startTrace(steps);
+
+	unsigned long long pairs = 0;
+	unsigned long long iterations = 0;
+	unsigned long long stepCounts = 0;
+	unsigned mostSteps = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (unsigned s = 0; s < steps; s++)
+	{
+		world.runPhysics(duration);
+		pairs += world.getPairCount();
+		iterations += world.getIterationsUsed();
+		stepCounts += world.getStepCount();
+		if (world.getStepCount() > mostSteps) mostSteps = world.getStepCount();
+	}
+	std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now();
+
+	double seconds = std::chrono::duration<double>(stop - start).count();
+	printf("particles %u threads %u resolver %s broadphase %s integrator %s step %s substeps %u simd %s parallel-contacts %s warm-start %s sleep %s\n",
+		particleCount, world.getWorkerPool().getThreadCount(), resolverName, broadphaseName, integratorName,
+		stepName, substeps, batchInstructionSet(), parallelContacts ? "on" : "off", warmStart ? "on" : "off",
+		sleep ? "on" : "off");
+	printf("steps %u time %.3f s  %.1f steps/s  %.3f ms/step  %.0f pairs/step  %.1f iterations/step\n",
+		steps, seconds, steps / seconds, 1000.0 * seconds / steps, (double)pairs / steps, (double)iterations / steps);
+	if (stepFraction > 0)
+	{
+		printf("cfl %.2f  %.2f steps/frame  most %u\n", stepFraction, (double)stepCounts / steps, mostSteps);
+	}
+	const ParticleContactArena &arena = world.getContactArena();
+	printf("contacts peak %u capacity %u grown %u times dropped %llu\n",
+		arena.getPeak(), arena.getCapacity(), arena.getGrowCount(), arena.getDroppedTotal());
+	printf("awake %u of %u\n", world.getAwakeCount(), particleCount);
+
+	//How well the pile is holding up: the deepest overlap between two particles, and how many got out of the box
+	const ParticleStore &store = world.getParticleStore();
+	const ParticleWorld::ParticlePairs &candidates = world.getCandidatePairs();
+	float deepest = 0;
+	for (unsigned i = 0; i < candidates.size(); i++)
+	{
+		unsigned a = candidates[i].index[0];
+		unsigned b = candidates[i].index[1];
+		float dx = store.positionX[a] - store.positionX[b];
+		float dy = store.positionY[a] - store.positionY[b];
+		float overlap = store.radius[a] + store.radius[b] - sqrt(dx * dx + dy * dy);
+		if (overlap > deepest) deepest = overlap;
+	}
+	unsigned escaped = 0;
+	for (unsigned i = 0; i < store.size(); i++)
+	{
+		if (fabs(store.positionX[i]) > halfSize || fabs(store.positionY[i]) > halfSize) escaped++;
+	}
+	printf("deepest overlap %.3f escaped %u\n", deepest, escaped);
+
+	if (profileName)
+	{
+		ParticleProfiler &profiler = world.getProfiler();
+		if (!ParticleProfiler::isCompiledIn())
+		{
+			printf("built without SPHERE_PROFILE, nothing to profile\n");
+			return 1;
+		}
+		profiler.writeSummary(std::cout);
+
+		std::ofstream trace(profileName);
+		profiler.writeTrace(trace);
+		if (!trace)
+		{
+			printf("couldn't write %s\n", profileName);
+			return 1;
+		}
+		printf("traced %u steps to %s\n", profiler.getTraceSize(), profileName);
+	}
+	return 0;
+}
@@ -0,0 +1,205 @@
+//Headless benchmark for the particle rendering
+//Renders a falling box of particles into an offscreen EGL pbuffer and reports how long each frame takes to draw
+//Needs no window or display server, Mesa's software renderer is enough, so it runs on headless machines
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+#include "coreMath.h"
+#include "pworld.h"
+#include "collision.h"
+#include "psegments.h"
+#include "prender.h"
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+//Sets up an offscreen desktop GL context, returns false if EGL can't provide one
+static bool createContext(int width, int height)
+{
+	EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, 0, 0))
+	{
+		//No default display on a headless box, so ask Mesa for its surfaceless platform instead
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (!getPlatformDisplay) return false;
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0);
+		if (display == EGL_NO_DISPLAY || !eglInitialize(display, 0, 0)) return false;
+	}
+
+	const EGLint configAttributes[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+		EGL_DEPTH_SIZE, 16,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint configCount = 0;
+	if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) || configCount == 0) return false;
+
+	const EGLint surfaceAttributes[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+	EGLSurface surface = eglCreatePbufferSurface(display, config, surfaceAttributes);
+	if (surface == EGL_NO_SURFACE) return false;
+
+	if (!eglBindAPI(EGL_OPENGL_API)) return false;
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, 0);
+	if (context == EGL_NO_CONTEXT) return false;
+	return eglMakeCurrent(display, surface, surface, context) == EGL_TRUE;
+}
+
+//The way BlobDemo used to draw, one matrix push and one small disc per particle in immediate mode
+//glutSolidSphere needs a GLUT window, so a disc with the same number of slices stands in for it
+static void drawImmediate(const ParticleSnapshot &snapshot)
+{
+	const unsigned slices = 12;
+	for (unsigned i = 0; i < snapshot.size(); i++)
+	{
+		glColor3f(snapshot.red[i], snapshot.green[i], snapshot.blue[i]);
+		glPushMatrix();
+		glTranslatef(snapshot.positionX[i], snapshot.positionY[i], 0);
+		glBegin(GL_TRIANGLE_FAN);
+		glVertex2f(0, 0);
+		for (unsigned s = 0; s <= slices; s++)
+		{
+			float angle = 2.0f * 3.14159265f * s / slices;
+			glVertex2f(cosf(angle) * snapshot.radius[i], sinf(angle) * snapshot.radius[i]);
+		}
+		glEnd();
+		glPopMatrix();
+	}
+}
+
+//Writes the current frame as a binary PPM, bottom row last
+static bool writeFrame(const char *filename, int width, int height)
+{
+	std::vector<unsigned char> pixels(width * height * 3);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+
+	FILE *file = fopen(filename, "wb");
+	if (!file) return false;
+	fprintf(file, "P6\n%d %d\n255\n", width, height);
+	for (int y = height - 1; y >= 0; y--) fwrite(&pixels[y * width * 3], 1, width * 3, file);
+	fclose(file);
+	return true;
+}
+
+static void usage()
+{
+	printf("usage: prenderbench [--particles N] [--frames N] [--size pixels]\n"
+		"                    [--mode batched|immediate] [--output frame.ppm]\n");
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned particleCount = 10000;
+	unsigned frames = 200;
+	int size = 800;
+	const char *modeName = "batched";
+	const char *output = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "--particles") && i + 1 < argc) particleCount = (unsigned)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--frames") && i + 1 < argc) frames = (unsigned)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--size") && i + 1 < argc) size = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--mode") && i + 1 < argc) modeName = argv[++i];
+		else if (!strcmp(argv[i], "--output") && i + 1 < argc) output = argv[++i];
+		else { usage(); return 1; }
+	}
+
+	bool batched;
+	if (!strcmp(modeName, "batched")) batched = true;
+	else if (!strcmp(modeName, "immediate")) batched = false;
+	else { usage(); return 1; }
+
+	if (!createContext(size, size))
+	{
+		printf("couldn't create an offscreen OpenGL context\n");
+		return 1;
+	}
+
+	//Same density as pbench, about a quarter of the box covered
+	float halfSize = sqrt((float)particleCount * 3.0f) * 1.5f;
+
+	ParticleWorld world(256);
+	world.getParticleStore().reserve(particleCount);
+	srand(1);
+	for (unsigned i = 0; i < particleCount; i++)
+	{
+		Particle *particle = world.createParticle();
+		float mass = 1.0f + 9.0f * (rand() / (float)RAND_MAX);
+		particle->setPosition(-halfSize + 2 * halfSize * (rand() / (float)RAND_MAX),
+			-halfSize + 2 * halfSize * (rand() / (float)RAND_MAX));
+		particle->setVelocity(0, 0);
+		particle->setAcceleration(Vector2::GRAVITY * 20.0f);
+		particle->setDamping(0.99f);
+		particle->setMass(mass);
+		particle->setRadius(0.5f + mass / 10.0f);
+		particle->setRed(1.0f - mass / 10.0f);
+		particle->setBlue(mass / 10.0f);
+	}
+
+	//The box is four segments, the particles collide with each other through the broadphase pairs
+	ParticleCollisionGenerator collisions(&world, 0.5f);
+	ParticleSegmentGenerator walls(&world, 0.5f);
+	walls.addSegment(Vector2(-halfSize, -halfSize), Vector2(halfSize, -halfSize));
+	walls.addSegment(Vector2(halfSize, -halfSize), Vector2(halfSize, halfSize));
+	walls.addSegment(Vector2(halfSize, halfSize), Vector2(-halfSize, halfSize));
+	walls.addSegment(Vector2(-halfSize, halfSize), Vector2(-halfSize, -halfSize));
+	walls.build();
+	world.getContactGenerators().push_back(&collisions);
+	world.getContactGenerators().push_back(&walls);
+
+	//The same fixed function setup as the demo
+	glViewport(0, 0, size, size);
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	glOrtho(-halfSize, halfSize, -halfSize, halfSize, -1.0, 1.0);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+
+	ParticleRenderer renderer;
+	double drawSeconds = 0;
+	for (unsigned f = 0; f < frames; f++)
+	{
+		world.runPhysics(0.01f);
+		world.publishSnapshot();
+		const ParticleSnapshot *snapshot = world.acquireSnapshot();
+
+		//Only the drawing is timed, glFinish waits for the frame to actually be rendered
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		if (batched)
+		{
+			renderer.pack(*snapshot);
+			renderer.draw();
+		}
+		else drawImmediate(*snapshot);
+		glFinish();
+		drawSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		world.releaseSnapshot(snapshot);
+	}
+
+	printf("particles %u frames %u size %dx%d mode %s renderer %s\n",
+		particleCount, frames, size, size, modeName, (const char*)glGetString(GL_RENDERER));
+	printf("draw %.3f ms/frame  %.1f frames/s\n", 1000.0 * drawSeconds / frames, frames / drawSeconds);
+
+	if (output && !writeFrame(output, size, size))
+	{
+		printf("couldn't write %s\n", output);
+		return 1;
+	}
+	renderer.releaseTexture();
+	return 0;
+}
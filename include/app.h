@@ -8,6 +8,8 @@ protected:
 	float nRange;
 	float timeinterval;
 public:
+	//Demos are deleted through this class, so their destructors must run
+	virtual ~Application() {}
     virtual void initGraphics();
     virtual void display();
 	virtual void update();
@@ -1,5 +1,9 @@
 #pragma once
 #include "particle.h"
+#include "pcontacts.h"
+#include "pstore.h"
+
+class ParticleWorld;
 
 //Collision class declaration
 //This class deals with the collisions between particles
@@ -16,4 +20,33 @@ public:
 	Collision(Particle *p1, Particle *p2);
 	bool checkForCollision();
 	void resolveCollision();
+	//Fills in a contact for the two particles without moving them, returns false if they don't touch
+	bool generateContact(ParticleContact *contact, float restitution) const;
+};
+
+//Allocation free narrowphase for the particles at indices a and b of the store
+//Reads the store's arrays directly, fills in the contact if they touch and returns the number written, zero or one
+unsigned particleContact(const ParticleStore &store, unsigned a, unsigned b, float restitution, ParticleContact *contact);
+
+//Contact generator that runs the collision check over the pairs found by the world's broadphase
+//The pairs are split into partitions so the world can check them on several threads
+class ParticleCollisionGenerator : public ParticleContactGenerator
+{
+public:
+	//Number of broadphase pairs in each partition
+	static const unsigned PAIRS_PER_PARTITION = 256;
+
+	//World whose candidate pairs are checked, and the restitution given to the contacts
+	ParticleWorld *world;
+	float restitution;
+
+	ParticleCollisionGenerator(ParticleWorld *world, float restitution);
+
+	virtual unsigned addContact(ParticleContact *contact, unsigned limit) const;
+	virtual unsigned getPartitionCount() const;
+	virtual unsigned addContactPartition(ParticleContact *contact, unsigned limit, unsigned partition) const;
+
+protected:
+	//Checks the candidate pairs in [begin, end)
+	unsigned addPairContacts(ParticleContact *contact, unsigned limit, unsigned begin, unsigned end) const;
 };
\ No newline at end of file
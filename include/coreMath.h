@@ -252,4 +252,46 @@ class Vector2
             y = -y;
         }
     };
+
+    /**
+     * Batch kernels over arrays of vector components. Each one has a
+     * scalar, SSE2 and AVX2 implementation; the widest one the CPU
+     * supports is picked the first time any of them runs. The arrays
+     * need no particular alignment and may be any length.
+     */
+
+    /** Adds x scaled by the given amount to y: y += x * scale. */
+    void batchAxpy(float *y, const float *x, float scale, unsigned count);
+
+    /**
+     * Adds x scaled by a per-element weight and the given amount to
+     * y: y += x * weight * scale.
+     */
+    void batchAxpyWeighted(float *y, const float *x, const float *weight,
+        float scale, unsigned count);
+
+    /**
+     * Scales both components of each vector by its own factor, as
+     * used to impose drag: x *= factor, y *= factor.
+     */
+    void batchDampingScale(float *x, float *y, const float *factor,
+        unsigned count);
+
+    /** Writes the magnitude of each vector into length. */
+    void batchLength(float *length, const float *x, const float *y,
+        unsigned count);
+
+    /** Turns each non-zero vector into a vector of unit length. */
+    void batchNormalise(float *x, float *y, unsigned count);
+
+    /** Writes the scalar product of each pair of vectors into result. */
+    void batchDot(float *result, const float *ax, const float *ay,
+        const float *bx, const float *by, unsigned count);
+
+    /**
+     * Returns the name of the instruction set the batch kernels are
+     * using: "avx2", "sse2" or "scalar".
+     */
+    const char* batchInstructionSet();
+
 	#endif // CORE_H
\ No newline at end of file
@@ -0,0 +1,127 @@
+/*
+ * Interface file for the per frame contact arena.
+ *
+ */
+#ifndef PARENA_H
+#define PARENA_H
+
+#include <vector>
+#include "pcontacts.h"
+
+/**
+    * Holds the contacts generated in one frame. The memory is kept
+    * from frame to frame and only ever grows, doubling when it runs
+    * out, so after the first few frames of a scene no allocation
+    * happens at all.
+    *
+    * The arena also keeps count of how it is used: the most contacts
+    * seen in a frame, and how many were thrown away because the
+    * world has a limit on the contacts it resolves. Together they
+    * say how big a scene's contact load really is, rather than
+    * having to guess a buffer size.
+    */
+class ParticleContactArena
+{
+protected:
+    /**
+        * Holds the contacts. Its size is the arena's capacity.
+        */
+    std::vector<ParticleContact> contacts;
+
+    /**
+        * Holds the number of contacts in use this frame.
+        */
+    unsigned used;
+
+    /**
+        * Holds the most contacts used in any one frame.
+        */
+    unsigned peak;
+
+    /**
+        * Holds the number of contacts dropped in the last frame, and
+        * in total.
+        */
+    unsigned droppedLastFrame;
+    unsigned long long droppedTotal;
+
+    /**
+        * Holds the number of times the arena has grown.
+        */
+    unsigned growCount;
+
+public:
+    /**
+        * Creates an arena with room for the given number of contacts.
+        */
+    ParticleContactArena(unsigned capacity);
+
+    /**
+        * Empties the arena for a new frame, keeping its memory.
+        */
+    void reset();
+
+    /**
+        * Makes sure there is room for at least the given number of
+        * contacts in total, at least doubling the capacity if it has
+        * to grow. The contacts already in the arena are kept, but
+        * pointers into it are not valid afterwards.
+        */
+    void reserve(unsigned count);
+
+    /**
+        * Returns the first contact. The arena's contacts are in one
+        * contiguous block.
+        */
+    ParticleContact* data();
+
+    /**
+        * Returns the contact at the given position.
+        */
+    ParticleContact* at(unsigned index);
+    const ParticleContact* at(unsigned index) const;
+
+    /**
+        * Returns the number of contacts there is room for.
+        */
+    unsigned getCapacity() const;
+
+    /**
+        * Sets the number of contacts in use this frame, and updates
+        * the peak.
+        */
+    void setUsed(unsigned count);
+
+    /**
+        * Returns the number of contacts in use this frame.
+        */
+    unsigned getUsed() const;
+
+    /**
+        * Trims the contacts in use down to the given limit, counting
+        * the rest as dropped. Returns the number in use afterwards.
+        */
+    unsigned limit(unsigned count);
+
+    /**
+        * Returns the most contacts generated in one frame.
+        */
+    unsigned getPeak() const;
+
+    /**
+        * Returns the contacts dropped in the last frame.
+        */
+    unsigned getDroppedLastFrame() const;
+
+    /**
+        * Returns the contacts dropped since the arena was created.
+        */
+    unsigned long long getDroppedTotal() const;
+
+    /**
+        * Returns the number of times the arena has had to grow.
+        */
+    unsigned getGrowCount() const;
+};
+
+#endif // PARENA_H
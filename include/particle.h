@@ -8,24 +8,22 @@
 #define PARTICLE_H
 
 #include "coreMath.h"
+#include "pstore.h"
 
 class Particle
 {
 protected:
-//Particle variables used to control all aspects of a particle
-//Self documenting
-float inverseMass;
-float damping;
-float radius;
-Vector2 position;
-Vector2 velocity;
-Vector2 forceAccum;
-Vector2 acceleration;
-int ID;
-bool collisionStatus;
-float red, green, blue;
+//A particle is a handle into a ParticleStore, its variables live in the
+//store's per field arrays at this index
+ParticleStore *store;
+unsigned index;
     
 public:
+	//Handles are created by the store, see ParticleStore::create
+	Particle(ParticleStore *store, unsigned index);
+	ParticleStore* getStore() const;
+	unsigned getIndex() const;
+
 	//A long list of accessor and mutator methods, I do not need to comment on each of these
 	//Code here is in my opinion, self documenting
 	void integrate(float duration);
@@ -58,6 +56,12 @@ public:
 	void clearAccumulator();
 	void addForce(const Vector2 &force);
 
+	//A sleeping particle isn't integrated and keeps still until it is woken.
+	//Adding a force or setting a non-zero velocity wakes it, putting it to
+	//sleep stops it dead
+	bool isAwake() const;
+	void setAwake(const bool awake = true);
+
 	int getID();
 	void setID(int i);
 
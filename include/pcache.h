@@ -0,0 +1,146 @@
+/*
+ * Interface file for the contact cache that carries impulses from one
+ * frame to the next.
+ *
+ */
+#ifndef PCACHE_H
+#define PCACHE_H
+
+#include <vector>
+#include "pcontacts.h"
+
+/**
+    * Remembers the impulse each contact needed last frame, so this
+    * frame's matching contact can start from it (a warm start)
+    * rather than from nothing.
+    *
+    * Every match gets last frame's impulse, then any contact left
+    * separating faster than it needs to (the impulse was from an
+    * impact, say) has the excess taken back off.
+    *
+    * Contacts are matched by the IDs of their particles (see
+    * Particle::getID), with the scenery as a missing second particle.
+    * Where a pair has more than one contact, for example a particle
+    * touching two walls, they are matched in the order they were
+    * generated. A match only counts if the contact normal has not
+    * turned by much, so a contact that has slid round to a different
+    * side of a particle starts from scratch.
+    *
+    * In a resting pile the impulses hardly change from frame to
+    * frame, so the warm start does most of the resolver's work
+    * before it begins. Support built up over several frames is
+    * kept, rather than rebuilt every frame from too few
+    * iterations, so piles sink into each other far less.
+    *
+    * The cache is a list sorted by key. Each frame's contacts are
+    * sorted the same way and merged against it in one pass, and the
+    * memory is kept between frames.
+    */
+class ParticleContactCache
+{
+public:
+    /**
+        * Stands in for the ID of the scenery.
+        */
+    static const unsigned SCENERY = 0xffffffff;
+
+protected:
+    /**
+        * One cached contact: the particle IDs, lower first, which
+        * contact between them this is, the normal (pointing at the
+        * lower ID particle) and the impulse it took. While warm
+        * starting, also the separating velocity it is aiming for.
+        */
+    struct Entry
+    {
+        unsigned first;
+        unsigned second;
+        unsigned ordinal;
+        unsigned contact;
+        Vector2 normal;
+        float impulse;
+        float target;
+
+        bool operator<(const Entry &other) const;
+    };
+
+    /**
+        * Holds last frame's contacts, sorted.
+        */
+    std::vector<Entry> previous;
+
+    /**
+        * Holds this frame's contacts, sorted, while they are being
+        * resolved.
+        */
+    std::vector<Entry> current;
+
+    /**
+        * Holds the fraction of the cached impulse applied.
+        */
+    float warmStartFactor;
+
+    /**
+        * Holds the smallest dot product between the old and new
+        * normals for a contact to count as the same.
+        */
+    float normalTolerance;
+
+    /**
+        * Holds the number of contacts warm started last frame.
+        */
+    unsigned matched;
+
+public:
+    /**
+        * Creates an empty cache.
+        */
+    ParticleContactCache();
+
+    /**
+        * Sets the fraction of last frame's impulse applied to a
+        * matching contact, normally between 0 and 1. The default of
+        * 0.8 leaves the resolver a little to do, which keeps bouncy
+        * contacts from gaining energy.
+        */
+    void setWarmStartFactor(float factor);
+
+    /**
+        * Sets the smallest cosine of the angle between last frame's
+        * normal and this frame's for contacts to match.
+        */
+    void setNormalTolerance(float tolerance);
+
+    /**
+        * Matches the given contacts against last frame's, applies
+        * the remembered impulse to the particles of each match and
+        * sets every contact's accumulated impulse to what was
+        * applied (zero if there was no match). Call it before the
+        * contacts are resolved.
+        */
+    void warmStart(ParticleContact *contactArray, unsigned numContacts);
+
+    /**
+        * Remembers the accumulated impulses of the contacts passed
+        * to the last warmStart, once they are resolved, for next
+        * frame.
+        */
+    void update(ParticleContact *contactArray, unsigned numContacts);
+
+    /**
+        * Forgets every cached contact.
+        */
+    void clear();
+
+    /**
+        * Returns the number of contacts warm started last frame.
+        */
+    unsigned getMatchedCount() const;
+
+    /**
+        * Returns the number of contacts in the cache.
+        */
+    unsigned getSize() const;
+};
+
+#endif // PCACHE_H
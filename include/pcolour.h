@@ -0,0 +1,133 @@
+/*
+ * Interface file for the graph coloured parallel contact resolver.
+ *
+ */
+#ifndef PCOLOUR_H
+#define PCOLOUR_H
+
+#include <vector>
+#include "pcontacts.h"
+#include "pworkers.h"
+
+/**
+    * An alternative to ParticleContactResolver for large numbers of
+    * contacts. The contacts are coloured so that no two contacts of
+    * the same colour share a particle; every contact in a colour can
+    * then be resolved at the same time on the worker threads without
+    * any locking. Each iteration sweeps through the colours in turn,
+    * and the resolver stops once no contact is closing faster than
+    * the velocity tolerance.
+    *
+    * The order contacts are resolved in differs from the sequential
+    * resolver, which always picks the worst contact next, so the
+    * results are not identical, but they converge to the same
+    * resting state.
+    */
+class ParticleColouredResolver
+{
+public:
+    /**
+        * The number of colours tracked per particle. Contacts that
+        * can't be given one of these (a particle touching more than
+        * this many others) go into one extra batch that is resolved
+        * on a single thread.
+        */
+    static const unsigned MAX_COLOURS = 64;
+
+protected:
+    /**
+        * Holds the maximum number of sweeps through all the colours.
+        */
+    unsigned iterations;
+
+    /**
+        * This is a performance tracking value - we keep a record
+        * of the actual number of sweeps used.
+        */
+    unsigned iterationsUsed;
+
+    /**
+        * Contacts closing slower than this are treated as resolved.
+        */
+    float velocityTolerance;
+
+    /**
+        * Holds the threads the colour batches are spread over.
+        */
+    WorkerPool *workers;
+
+    /**
+        * Holds the colours already used by each particle's contacts
+        * this frame, one bit per colour, indexed by store index.
+        */
+    std::vector<unsigned long long> particleColours;
+
+    /**
+        * Holds the colour of each contact, then the contact indices
+        * sorted by colour, and where each colour's batch starts in
+        * that list (with one extra entry at the end).
+        */
+    std::vector<unsigned> contactColour;
+    std::vector<unsigned> colourOrder;
+    std::vector<unsigned> colourStart;
+    std::vector<unsigned> colourCursor;
+
+    /**
+        * Holds the number of colours used this frame, including the
+        * overflow batch if it is used.
+        */
+    unsigned colourCount;
+
+    /**
+        * The worst closing velocity seen by each thread in the
+        * current sweep, padded onto separate cache lines.
+        */
+    struct ThreadWorst
+    {
+        float closingVelocity;
+        char padding[60];
+    };
+    std::vector<ThreadWorst> threadWorst;
+
+    /**
+        * Colours the contacts and sorts them into batches.
+        */
+    void colourContacts(ParticleContact *contactArray, unsigned numContacts);
+
+public:
+    /**
+        * Creates a new resolver that runs on the given workers.
+        */
+    ParticleColouredResolver(WorkerPool *workers, unsigned iterations);
+
+    /**
+        * Sets the maximum number of sweeps.
+        */
+    void setIterations(unsigned iterations);
+
+    /**
+        * Sets the closing velocity below which a contact counts as
+        * resolved.
+        */
+    void setVelocityTolerance(float tolerance);
+
+    /**
+        * Returns the number of sweeps used by the last call.
+        */
+    unsigned getIterationsUsed() const;
+
+    /**
+        * Returns the number of colour batches used by the last call.
+        */
+    unsigned getColourCount() const;
+
+    /**
+        * Resolves a set of particle contacts for velocity. All the
+        * contacts must use particles from the same store.
+        */
+    void resolveContacts(ParticleContact *contactArray,
+        unsigned numContacts,
+        float duration);
+};
+
+#endif // PCOLOUR_H
@@ -6,6 +6,7 @@
 #ifndef PCONTACTS_H
 #define PCONTACTS_H
 
+#include <vector>
 #include "particle.h"
 
 
@@ -22,11 +23,15 @@ class ParticleContact
         * set and effect the contact.
         */
     friend ParticleContactResolver;
+    friend class ParticleColouredResolver;
+    friend class ParticleHeapResolver;
+    friend class ParticleContactCache;
 
 public:
     /**
         * Holds the particles that are involved in the contact. The
         * second of these can be NULL, for contacts with the scenery.
+        * Both must come from the same ParticleStore.
         */
     Particle* particle[2];
 
@@ -45,24 +50,55 @@ public:
         */
     float penetration;
 
+    /**
+        * Holds the total amount each particle was moved by the last
+        * interpenetration resolution.
+        */
+    Vector2 particleMovement[2];
 
-protected:
     /**
-        * Resolves this contact, for both velocity and interpenetration.
+        * Holds the total impulse applied at this contact this frame,
+        * including any warm start from the contact cache. Set by the
+        * world before the contacts are resolved, generators don't
+        * need to fill it in.
         */
-    void resolve(float duration);
+    float accumulatedImpulse;
 
     /**
         * Calculates the separating velocity at this contact.
         */
     float calculateSeparatingVelocity() const;
 
+    /**
+        * Applies the impulse that makes the particles separate at
+        * exactly the given velocity. Used to set the velocities of
+        * position based contacts after they are solved.
+        */
+    void setSeparatingVelocity(float separatingVelocity);
+
+
+protected:
+    /**
+        * Resolves this contact's velocity. Interpenetration is
+        * resolved for all the contacts together, afterwards, by
+        * ParticleContactResolver::resolveInterpenetration.
+        */
+    void resolve(float duration);
+
 private:
     /**
         * Handles the impulse calculations for this collision.
         */
     void resolveVelocity(float duration);
 
+    /**
+        * Works out how far each particle would have to move to
+        * remove the interpenetration on its own, in proportion to
+        * its inverse mass, and writes it into the given moves.
+        * Doesn't move anything.
+        */
+    void calculateInterpenetration(Vector2 move[2]) const;
+
 };
 
 /**
@@ -83,6 +119,33 @@ protected:
         */
     unsigned iterationsUsed;
 
+    /**
+        * Holds the number of interpenetration passes allowed, and
+        * the number used last time.
+        */
+    unsigned positionIterations;
+    unsigned positionIterationsUsed;
+
+    /**
+        * Penetration shallower than this is left alone.
+        */
+    float penetrationTolerance;
+
+    /**
+        * Contacts closing slower than this are left alone. Zero by
+        * default, so every closing contact is resolved.
+        */
+    float velocityTolerance;
+
+    /**
+        * Per particle movement accumulated during an interpenetration
+        * pass, and the number of contacts contributing, indexed by
+        * store index. Kept zeroed between passes.
+        */
+    std::vector<float> moveX;
+    std::vector<float> moveY;
+    std::vector<float> moveShare;
+
 public:
     /**
         * Creates a new contact resolver.
@@ -94,6 +157,32 @@ public:
         */
     void setIterations(unsigned iterations);
 
+    /**
+        * Sets the number of interpenetration passes that can be used.
+        */
+    void setPositionIterations(unsigned iterations);
+
+    /**
+        * Sets the depth below which penetration is left alone.
+        */
+    void setPenetrationTolerance(float tolerance);
+    float getPenetrationTolerance() const;
+
+    /**
+        * Sets the closing velocity below which a contact is left
+        * alone. With warm starting, a small tolerance lets a resting
+        * pile stop after a few iterations rather than chasing
+        * rounding errors.
+        */
+    void setVelocityTolerance(float tolerance);
+
+    /**
+        * Returns the number of iterations and interpenetration passes
+        * used by the last call.
+        */
+    unsigned getIterationsUsed() const;
+    unsigned getPositionIterationsUsed() const;
+
     /**
         * Resolves a set of particle contacts for both penetration
         * and velocity.
@@ -102,6 +191,31 @@ public:
     void resolveContacts(ParticleContact *contactArray,
         unsigned numContacts,
         float duration);
+
+    /**
+        * Moves the particles apart to remove the interpenetration at
+        * a set of contacts. Each pass works out the movement every
+        * penetrating contact needs, in proportion to the inverse
+        * masses, averages it per particle, applies it, and updates
+        * the penetration of every contact the moved particles are
+        * in. Passes repeat until nothing penetrates deeper than the
+        * tolerance or the passes run out. All the contacts must use
+        * particles from the same store.
+        */
+    void resolveInterpenetration(ParticleContact *contactArray,
+        unsigned numContacts);
+
+    /**
+        * Solves the contacts as position constraints, one after the
+        * other: each pushes its particles apart by however deep it
+        * still is after the moves the contacts before it made. Passes
+        * repeat until nothing is deeper than the tolerance or the
+        * passes run out. Converges much faster in a deep pile than
+        * resolveInterpenetration, but the result depends on the
+        * contact order, so it runs on one thread.
+        */
+    void resolvePositions(ParticleContact *contactArray,
+        unsigned numContacts);
 };
 
 /**
@@ -111,12 +225,125 @@ public:
 class ParticleContactGenerator
 {
 public:
+    virtual ~ParticleContactGenerator() {}
+
     /**
         * Fills the given contact structure with the generated
         * contact. 
         */
     virtual unsigned addContact(ParticleContact *contact,
                                 unsigned limit) const = 0;
+
+    /**
+        * Returns the number of independent pieces this generator's
+        * work can be split into. Partitions may be generated at the
+        * same time on different threads. By default the generator
+        * is a single partition.
+        */
+    virtual unsigned getPartitionCount() const;
+
+    /**
+        * Fills the given contact structure with the contacts from
+        * one partition. Running every partition in order must give
+        * the same contacts, in the same order, as addContact. By
+        * default partition zero calls addContact.
+        */
+    virtual unsigned addContactPartition(ParticleContact *contact,
+                                         unsigned limit,
+                                         unsigned partition) const;
+};
+
+/**
+    * A contact generator that works on a whole span of particles in
+    * one call, rather than being tied to a single particle. One
+    * instance can cover every particle in the world, running a tight
+    * loop over the store's arrays.
+    *
+    * The particle list is split into fixed size spans, one per
+    * partition, so the world can generate them on several threads.
+    * Subclasses only implement addContactBatch.
+    */
+class ParticleBatchContactGenerator : public ParticleContactGenerator
+{
+public:
+    /**
+        * The number of particles in each partition.
+        */
+    static const unsigned PARTICLES_PER_PARTITION = 512;
+
+protected:
+    /**
+        * Holds the particles to generate contacts for, normally the
+        * world's particle list.
+        */
+    const ParticleStore::Handles *particles;
+
+public:
+    /**
+        * Creates a generator covering the given particles.
+        */
+    ParticleBatchContactGenerator(const ParticleStore::Handles *particles);
+
+    /**
+        * Fills the given contact structure with the contacts for the
+        * count particles starting at batch, writing at most limit.
+        * All the particles come from the same store.
+        */
+    virtual unsigned addContactBatch(Particle *const *batch,
+                                     unsigned count,
+                                     ParticleContact *contact,
+                                     unsigned limit) const = 0;
+
+    virtual unsigned addContact(ParticleContact *contact,
+                                unsigned limit) const;
+    virtual unsigned getPartitionCount() const;
+    virtual unsigned addContactPartition(ParticleContact *contact,
+                                         unsigned limit,
+                                         unsigned partition) const;
+};
+
+/**
+    * Runs a generator written for a single particle, one with a
+    * public particle pointer like the demo's platforms, over every
+    * particle in a batch. The prototype is copied for each batch so
+    * batches can run on several threads at once.
+    */
+template <class Generator>
+class ParticleGeneratorAdapter : public ParticleBatchContactGenerator
+{
+protected:
+    /**
+        * Holds the generator whose settings are copied.
+        */
+    const Generator *prototype;
+
+public:
+    /**
+        * Creates an adapter running the given generator over the
+        * given particles.
+        */
+    ParticleGeneratorAdapter(const Generator *prototype,
+                             const ParticleStore::Handles *particles)
+    :
+    ParticleBatchContactGenerator(particles),
+    prototype(prototype)
+    {
+    }
+
+    virtual unsigned addContactBatch(Particle *const *batch,
+                                     unsigned count,
+                                     ParticleContact *contact,
+                                     unsigned limit) const
+    {
+        Generator generator(*prototype);
+        unsigned used = 0;
+        for (unsigned i = 0; i < count && used < limit; i++)
+        {
+            generator.particle = batch[i];
+            used += generator.addContact(contact + used, limit - used);
+        }
+        return used;
+    }
 };
 
 	
@@ -0,0 +1,119 @@
+/*
+ * Interface file for the uniform spatial hash grid used as the
+ * broadphase for particle-particle collisions.
+ *
+ */
+#ifndef PGRID_H
+#define PGRID_H
+
+#include <vector>
+#include "pstore.h"
+
+/**
+    * A candidate pair produced by the broadphase. The indices refer
+    * to the world's particle store; the pair only says the two
+    * particles' bounding boxes overlap, the narrowphase has to decide
+    * whether they actually touch.
+    */
+struct ParticlePair
+{
+    unsigned index[2];
+};
+
+/**
+    * A uniform grid hashed into a fixed size table. The cell size is
+    * derived from the largest particle radius, so any two touching
+    * particles are always in the same or in neighbouring cells and
+    * each particle only has to be checked against the 3x3 block of
+    * cells around it.
+    */
+class ParticleGrid
+{
+public:
+    typedef std::vector<ParticlePair> ParticlePairs;
+
+protected:
+    /**
+        * Holds the edge length of a cell and its reciprocal.
+        */
+    float cellSize;
+    float inverseCellSize;
+
+    /**
+        * Holds the number of buckets in the hash table minus one.
+        * The table size is always a power of two.
+        */
+    unsigned tableMask;
+
+    /**
+        * Holds the store the grid was last built from.
+        */
+    const ParticleStore *store;
+
+    /**
+        * Holds the cell each particle is in, indexed the same as the
+        * store.
+        */
+    std::vector<int> cellX;
+    std::vector<int> cellY;
+
+    /**
+        * Holds how far each particle's box reaches from its centre:
+        * its radius, plus its margin if there are margins.
+        */
+    std::vector<float> extent;
+
+    /**
+        * Holds how much each particle's box is grown by on each side,
+        * indexed the same as the store, or null for none.
+        */
+    const std::vector<float> *margins;
+
+    /**
+        * Holds the particle indices sorted by bucket, and the offset
+        * of the first entry of each bucket (with one extra entry at
+        * the end so bucket b is [bucketStart[b], bucketStart[b+1]).
+        */
+    std::vector<unsigned> sortedIndex;
+    std::vector<unsigned> bucketStart;
+
+    /**
+        * Returns the bucket the given cell hashes to.
+        */
+    unsigned hashCell(int x, int y) const;
+
+public:
+    /**
+        * Creates an empty grid.
+        */
+    ParticleGrid();
+
+    /**
+        * Rebuilds the grid from the given particles. The memory used
+        * by the grid is kept between calls, so rebuilding every frame
+        * only allocates when the particle count grows.
+        */
+    void build(const ParticleStore &store);
+
+    /**
+        * Sets how much each particle's box is grown by on each side,
+        * so pairs that will touch after moving that far are found
+        * too. The array is read at the next build and must have an
+        * entry per particle; null turns the margins off.
+        */
+    void setMargins(const std::vector<float> *margins);
+
+    /**
+        * Fills the given list with every pair of particles whose
+        * bounding boxes overlap. The list is cleared first. Each pair
+        * is reported once, with the lower index first.
+        */
+    void findPairs(ParticlePairs &pairs) const;
+
+    /**
+        * Returns the cell size used by the last build.
+        */
+    float getCellSize() const;
+};
+
+#endif // PGRID_H
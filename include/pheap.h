@@ -0,0 +1,118 @@
+/*
+ * Interface file for the indexed heap contact resolver.
+ *
+ */
+#ifndef PHEAP_H
+#define PHEAP_H
+
+#include <vector>
+#include "pcontacts.h"
+
+/**
+    * A contact resolver that resolves contacts in exactly the same
+    * order as ParticleContactResolver - always the contact with the
+    * largest closing velocity next - but without rescanning every
+    * contact each iteration.
+    *
+    * The contacts waiting to be resolved are kept in a binary heap
+    * keyed on separating velocity, with an index from contact to heap
+    * slot so any contact can be re-keyed in place. Resolving a
+    * contact only changes the velocities of its own particles, so
+    * afterwards only the contacts sharing one of those particles
+    * (found through a particle to contact adjacency list) need their
+    * keys updated. A full solve is O(n log n) rather than O(n^2).
+    */
+class ParticleHeapResolver : public ParticleContactResolver
+{
+protected:
+    /**
+        * Holds the contact indices in heap order, smallest
+        * separating velocity first, ties going to the lower index.
+        */
+    std::vector<unsigned> heap;
+
+    /**
+        * Holds the heap slot of each contact, or NOT_QUEUED.
+        */
+    std::vector<unsigned> heapSlot;
+
+    /**
+        * Holds the separating velocity of each queued contact.
+        */
+    std::vector<float> key;
+
+    /**
+        * Holds, for each movable particle the contacts touch, the
+        * contacts it is part of: adjacency[adjacencyStart[p] ..
+        * adjacencyStart[p+1]), with p its local index.
+        */
+    std::vector<unsigned> adjacencyStart;
+    std::vector<unsigned> adjacency;
+
+    /**
+        * Holds the local index of each contact's two particles, or
+        * NO_LOCAL for a missing or fixed one.
+        */
+    std::vector<unsigned> contactLocal;
+
+    /**
+        * Maps store indices to local ones while the adjacency is
+        * built, and lists the store indices given one so the map can
+        * be left clear again.
+        */
+    std::vector<unsigned> localIndex;
+    std::vector<unsigned> touched;
+
+    /**
+        * Marks a contact that isn't in the heap.
+        */
+    static const unsigned NOT_QUEUED = 0xffffffff;
+
+    /**
+        * Marks a particle with no local index.
+        */
+    static const unsigned NO_LOCAL = 0xffffffff;
+
+    /**
+        * Returns true if contact a should be resolved before b.
+        */
+    bool before(unsigned a, unsigned b) const;
+
+    /**
+        * Restores the heap order around the given slot.
+        */
+    void siftUp(unsigned slot);
+    void siftDown(unsigned slot);
+
+    /**
+        * Recomputes the key of the given contact and adds it to,
+        * moves it in or removes it from the heap as needed.
+        */
+    void update(ParticleContact *contactArray, unsigned contact);
+
+    /**
+        * Builds the particle to contact adjacency list over the
+        * movable particles the contacts touch, in time proportional
+        * to the number of contacts. Fixed particles are left out:
+        * their velocity never changes, so resolving a contact can't
+        * change the others through them.
+        */
+    void buildAdjacency(ParticleContact *contactArray, unsigned numContacts);
+
+public:
+    /**
+        * Creates a new contact resolver.
+        */
+    ParticleHeapResolver(unsigned iterations);
+
+    /**
+        * Resolves a set of particle contacts, giving the same result
+        * as ParticleContactResolver::resolveContacts. All the
+        * contacts must use particles from the same store.
+        */
+    void resolveContacts(ParticleContact *contactArray,
+        unsigned numContacts,
+        float duration);
+};
+
+#endif // PHEAP_H
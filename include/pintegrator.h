@@ -0,0 +1,133 @@
+/*
+ * Interface file for the integration policies.
+ *
+ */
+#ifndef PINTEGRATOR_H
+#define PINTEGRATOR_H
+
+#include "coreMath.h"
+
+/**
+    * A run of particles to integrate, as pointers into the store's
+    * arrays and the world's per particle factors. The mask is one for
+    * particles that move and zero for the rest; the force scale is
+    * the inverse mass where the mask is one. The drag factor is
+    * pow(damping, duration) and is only read by damped integration.
+    */
+struct IntegrationSpan
+{
+    float *positionX;
+    float *positionY;
+    float *velocityX;
+    float *velocityY;
+    const float *accelerationX;
+    const float *accelerationY;
+    const float *forceAccumX;
+    const float *forceAccumY;
+    const float *mask;
+    const float *forceScale;
+    const float *dragFactor;
+    unsigned count;
+};
+
+/**
+    * The constants of one step, worked out once per integrate call
+    * rather than once per particle.
+    */
+struct IntegrationStep
+{
+    float duration;
+    float halfDurationSquared;
+
+    IntegrationStep(float duration)
+    :
+    duration(duration),
+    halfDurationSquared(0.5f * duration * duration)
+    {
+    }
+};
+
+/**
+    * The policies below each integrate a span with the batch kernels
+    * from coreMath.h. They are picked at compile time: the world
+    * instantiates its integration loop once per policy, and once with
+    * and once without drag, so the undamped loops have no drag pass
+    * and no pow at all. The force accumulators aren't cleared here.
+    */
+
+/**
+    * Moves the particles with their old velocities, then updates the
+    * velocities. The engine's original scheme, and the default.
+    */
+struct ParticleEulerIntegrator
+{
+    template <bool Damped>
+    static void integrate(const IntegrationSpan &span, const IntegrationStep &step)
+    {
+        unsigned count = span.count;
+        float duration = step.duration;
+        batchAxpyWeighted(span.positionX, span.velocityX, span.mask, duration, count);
+        batchAxpyWeighted(span.positionY, span.velocityY, span.mask, duration, count);
+        accelerate<Damped>(span, step);
+    }
+
+    /**
+        * Adds the acceleration and force to the velocities, then
+        * imposes drag. Shared by all the policies.
+        */
+    template <bool Damped>
+    static void accelerate(const IntegrationSpan &span, const IntegrationStep &step)
+    {
+        unsigned count = span.count;
+        float duration = step.duration;
+        batchAxpyWeighted(span.velocityX, span.accelerationX, span.mask, duration, count);
+        batchAxpyWeighted(span.velocityY, span.accelerationY, span.mask, duration, count);
+        batchAxpyWeighted(span.velocityX, span.forceAccumX, span.forceScale, duration, count);
+        batchAxpyWeighted(span.velocityY, span.forceAccumY, span.forceScale, duration, count);
+        if (Damped) batchDampingScale(span.velocityX, span.velocityY, span.dragFactor, count);
+    }
+};
+
+/**
+    * Updates the velocities first, then moves the particles with the
+    * new ones. Keeps orbits and springs from gaining energy the way
+    * the default scheme slowly does.
+    */
+struct ParticleSymplecticEulerIntegrator
+{
+    template <bool Damped>
+    static void integrate(const IntegrationSpan &span, const IntegrationStep &step)
+    {
+        unsigned count = span.count;
+        float duration = step.duration;
+        ParticleEulerIntegrator::accelerate<Damped>(span, step);
+        batchAxpyWeighted(span.positionX, span.velocityX, span.mask, duration, count);
+        batchAxpyWeighted(span.positionY, span.velocityY, span.mask, duration, count);
+    }
+};
+
+/**
+    * Velocity Verlet for accelerations that are constant over the
+    * step: the particles move with their old velocities plus half a
+    * step of the acceleration, which is exact under gravity, then the
+    * velocities are updated as usual.
+    */
+struct ParticleVerletIntegrator
+{
+    template <bool Damped>
+    static void integrate(const IntegrationSpan &span, const IntegrationStep &step)
+    {
+        unsigned count = span.count;
+        float duration = step.duration;
+        float half = step.halfDurationSquared;
+        batchAxpyWeighted(span.positionX, span.velocityX, span.mask, duration, count);
+        batchAxpyWeighted(span.positionY, span.velocityY, span.mask, duration, count);
+        batchAxpyWeighted(span.positionX, span.accelerationX, span.mask, half, count);
+        batchAxpyWeighted(span.positionY, span.accelerationY, span.mask, half, count);
+        batchAxpyWeighted(span.positionX, span.forceAccumX, span.forceScale, half, count);
+        batchAxpyWeighted(span.positionY, span.forceAccumY, span.forceScale, half, count);
+        ParticleEulerIntegrator::accelerate<Damped>(span, step);
+    }
+};
+
+#endif // PINTEGRATOR_H
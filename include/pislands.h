@@ -0,0 +1,166 @@
+/*
+ * Interface file for the contact island resolver.
+ *
+ */
+#ifndef PISLANDS_H
+#define PISLANDS_H
+
+#include <vector>
+#include "pcontacts.h"
+#include "pheap.h"
+#include "pworkers.h"
+
+/**
+    * Splits a frame's contacts into islands - groups of particles
+    * touching each other, directly or through a chain of contacts -
+    * and resolves every island on its own, spread over the worker
+    * threads. Particles in different islands share no contacts, so
+    * the islands can't affect each other and need no locking.
+    *
+    * The islands are found with a union-find over the particles of
+    * each contact. Fixed particles (including sleeping ones the world
+    * has pinned) don't join islands together, the same way the
+    * scenery doesn't: nothing an island does can move them.
+    *
+    * Each island is resolved worst contact first, as by
+    * ParticleContactResolver, with its own iteration budget. Islands
+    * with many contacts use ParticleHeapResolver, which resolves in
+    * the same order without rescanning every contact each iteration.
+    */
+class ParticleIslands
+{
+public:
+    /**
+        * Marks a particle or contact that isn't in any island.
+        */
+    static const unsigned NO_ISLAND = 0xffffffff;
+
+    /**
+        * Islands with more contacts than this are resolved with the
+        * heap resolver.
+        */
+    static const unsigned HEAP_CONTACTS = 64;
+
+protected:
+    /**
+        * The resolvers used by one thread, and the iterations they
+        * used this frame. Padded so threads don't share a line.
+        */
+    struct ThreadResolver
+    {
+        ParticleContactResolver resolver;
+        ParticleHeapResolver heapResolver;
+        unsigned iterationsUsed;
+        char padding[64];
+
+        ThreadResolver();
+    };
+
+    /**
+        * Holds the threads the islands are spread over.
+        */
+    WorkerPool *workers;
+
+    /**
+        * Holds the iterations each island may use, or zero for twice
+        * the island's contacts.
+        */
+    unsigned iterations;
+
+    /**
+        * Holds the total iterations used by all the islands.
+        */
+    unsigned iterationsUsed;
+
+    /**
+        * Contacts closing slower than this are left alone.
+        */
+    float velocityTolerance;
+
+    /**
+        * The union-find forest over the store's particles, and the
+        * island each root and then each particle ended up in.
+        */
+    std::vector<unsigned> parent;
+    std::vector<unsigned> rootIsland;
+    std::vector<unsigned> particleIsland;
+
+    /**
+        * Holds the island of each contact, then the contacts copied
+        * out island by island, where each came from, and where each
+        * island's contacts start (with one extra entry at the end).
+        */
+    std::vector<unsigned> contactIsland;
+    std::vector<ParticleContact> islandContacts;
+    std::vector<unsigned> islandSource;
+    std::vector<unsigned> islandStart;
+
+    /**
+        * Holds the islands, largest first, so a big island doesn't
+        * start last and hold up the frame.
+        */
+    std::vector<unsigned> islandOrder;
+
+    std::vector<ThreadResolver> threadResolvers;
+
+    /**
+        * Returns the root of the given particle's tree, halving the
+        * path on the way.
+        */
+    unsigned find(unsigned particle);
+
+    /**
+        * Finds the islands and copies the contacts out into island
+        * order.
+        */
+    void build(ParticleContact *contactArray, unsigned numContacts);
+
+public:
+    /**
+        * Creates a resolver running on the given workers, giving
+        * each island the given number of iterations.
+        */
+    ParticleIslands(WorkerPool *workers, unsigned iterations = 0);
+
+    /**
+        * Sets the iterations each island may use. Zero gives each
+        * island twice as many iterations as it has contacts.
+        */
+    void setIterations(unsigned iterations);
+
+    /**
+        * Sets the closing velocity below which a contact is left
+        * alone.
+        */
+    void setVelocityTolerance(float tolerance);
+
+    /**
+        * Returns the iterations used by all the islands together in
+        * the last call.
+        */
+    unsigned getIterationsUsed() const;
+
+    /**
+        * Returns the number of islands found by the last call.
+        */
+    unsigned getIslandCount() const;
+
+    /**
+        * Returns the island the given particle (by store index) was
+        * in during the last call, or NO_ISLAND if it had no contacts
+        * or can't move.
+        */
+    unsigned getIsland(unsigned particle) const;
+
+    /**
+        * Resolves a set of particle contacts for both velocity and
+        * penetration, one island at a time. All the contacts must use
+        * particles from the same store. Called with no contacts, it
+        * just forgets the last call's islands.
+        */
+    void resolveContacts(ParticleContact *contactArray,
+        unsigned numContacts,
+        float duration);
+};
+
+#endif // PISLANDS_H
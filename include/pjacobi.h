@@ -0,0 +1,146 @@
+/*
+ * Interface file for the Jacobi style batched velocity solver.
+ *
+ */
+#ifndef PJACOBI_H
+#define PJACOBI_H
+
+#include <vector>
+#include "pcontacts.h"
+#include "pworkers.h"
+
+/**
+    * A velocity solver that works on every contact at once. Each
+    * sweep computes the impulse for every contact from the same
+    * starting velocities, accumulates the resulting velocity changes
+    * per particle and applies them all together at the end of the
+    * sweep. A particle touched by several contacts gets the average
+    * of their changes, scaled by the relaxation factor, so a pile of
+    * contacts pushing on one particle doesn't overshoot.
+    *
+    * The contact data is copied into one array per field and the
+    * velocities of the particles involved into a compact local set
+    * (with an extra immovable slot standing in for the scenery), so
+    * the impulse calculation is a straight, branch free loop the
+    * batch kernels and the compiler can vectorise.
+    *
+    * Because every contact sees the same velocities, the work per
+    * sweep and so the frame time only depend on the number of
+    * contacts, not on how they are arranged.
+    */
+class ParticleJacobiResolver
+{
+protected:
+    /**
+        * Holds the maximum number of sweeps.
+        */
+    unsigned iterations;
+
+    /**
+        * This is a performance tracking value - we keep a record
+        * of the actual number of sweeps used.
+        */
+    unsigned iterationsUsed;
+
+    /**
+        * Contacts closing slower than this are treated as resolved.
+        * Zero runs the full number of sweeps every time.
+        */
+    float velocityTolerance;
+
+    /**
+        * Scales the averaged velocity change applied each sweep.
+        */
+    float relaxation;
+
+    /**
+        * Holds the threads the impulse calculation is spread over.
+        */
+    WorkerPool *workers;
+
+    /**
+        * Per contact data, one array per field. The particle indices
+        * are local: the scenery maps to the last local slot.
+        */
+    std::vector<unsigned> bodyA;
+    std::vector<unsigned> bodyB;
+    std::vector<float> normalX;
+    std::vector<float> normalY;
+    std::vector<float> restitutionFactor;
+    std::vector<float> inverseMassTotal;
+    std::vector<float> relativeX;
+    std::vector<float> relativeY;
+    std::vector<float> separatingVelocity;
+    std::vector<float> impulse;
+
+    /**
+        * Per particle data for the particles in the contacts, in
+        * local order, plus the store index each one came from.
+        */
+    std::vector<unsigned> storeIndex;
+    std::vector<float> velocityX;
+    std::vector<float> velocityY;
+    std::vector<float> inverseMass;
+    std::vector<float> deltaX;
+    std::vector<float> deltaY;
+    std::vector<float> contactShare;
+
+    /**
+        * Maps store indices to local ones. Only the entries used in
+        * the last solve are set.
+        */
+    std::vector<unsigned> localIndex;
+
+    /**
+        * Marks a store index with no local slot.
+        */
+    static const unsigned NO_SLOT = 0xffffffff;
+
+    /**
+        * Copies the contacts and their particles into the local
+        * arrays.
+        */
+    void gather(ParticleContact *contactArray, unsigned numContacts);
+
+    /**
+        * Copies the solved velocities back into the store.
+        */
+    void scatter(ParticleStore &store);
+
+public:
+    /**
+        * Creates a new solver running on the given workers.
+        */
+    ParticleJacobiResolver(WorkerPool *workers, unsigned iterations);
+
+    /**
+        * Sets the maximum number of sweeps.
+        */
+    void setIterations(unsigned iterations);
+
+    /**
+        * Sets the closing velocity below which the solver stops
+        * early. Zero always runs every sweep.
+        */
+    void setVelocityTolerance(float tolerance);
+
+    /**
+        * Sets the relaxation factor, normally between 0 and 1.
+        */
+    void setRelaxation(float relaxation);
+
+    /**
+        * Returns the number of sweeps used by the last call.
+        */
+    unsigned getIterationsUsed() const;
+
+    /**
+        * Resolves a set of particle contacts for velocity. All the
+        * contacts must use particles from the same store.
+        */
+    void resolveContacts(ParticleContact *contactArray,
+        unsigned numContacts,
+        float duration);
+};
+
+#endif // PJACOBI_H
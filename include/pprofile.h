@@ -0,0 +1,268 @@
+/*
+ * Interface file for the per phase frame profiler.
+ *
+ */
+#ifndef PPROFILE_H
+#define PPROFILE_H
+
+#include <chrono>
+#include <ostream>
+#include <vector>
+
+/**
+    * Records how long each phase of every frame takes, along with a
+    * few counts per frame, and keeps the last HISTORY_FRAMES of them
+    * for a rolling summary. A trace of consecutive frames can also be
+    * recorded and written out as Chrome trace event JSON, to be
+    * opened in chrome://tracing or Perfetto.
+    *
+    * The world reports to its profiler through the macros below,
+    * which only do anything when SPHERE_PROFILE is defined; otherwise
+    * they compile to nothing and the profiler stays empty. Recording
+    * a frame doesn't allocate: the history is a fixed ring and the
+    * trace room is reserved when it starts.
+    */
+class ParticleProfiler
+{
+public:
+    /**
+        * The timed phases of a frame. PHASE_FRAME covers the whole of
+        * runPhysics, the rest are parts of it.
+        */
+    enum Phase
+    {
+        PHASE_FRAME,
+        PHASE_INTEGRATE,
+        PHASE_BROADPHASE,
+        PHASE_NARROWPHASE,
+        PHASE_RESOLVE,
+        PHASE_SLEEP,
+        PHASE_COUNT
+    };
+
+    /**
+        * The counts recorded each frame.
+        */
+    enum Counter
+    {
+        /** Candidate pairs the broadphase handed the narrowphase. */
+        COUNTER_PAIRS,
+
+        /** Contacts the generators found, including dropped ones. */
+        COUNTER_CONTACTS,
+
+        /** Contacts dropped to keep within the contact limit. */
+        COUNTER_DROPPED,
+
+        /** Iterations (or sweeps) the resolver used. */
+        COUNTER_ITERATIONS,
+
+        /** Particles awake at the end of the frame. */
+        COUNTER_AWAKE,
+
+        /** Steps (or substeps) the frame was split into. */
+        COUNTER_STEPS,
+
+        COUNTER_COUNT
+    };
+
+    /**
+        * The number of frames the rolling summary covers.
+        */
+    static const unsigned HISTORY_FRAMES = 120;
+
+    /**
+        * The most timed scopes kept for the trace each frame. Scopes
+        * past these still count towards the phase times.
+        */
+    static const unsigned MAX_FRAME_EVENTS = 256;
+
+    /**
+        * The summed times and counts of one frame. Times are in
+        * microseconds, the start from the profiler's epoch. A phase
+        * timed more than once in a frame has its times added up.
+        */
+    struct Frame
+    {
+        unsigned number;
+        double start;
+        float phaseTime[PHASE_COUNT];
+        unsigned counter[COUNTER_COUNT];
+    };
+
+    /**
+        * One timed scope, in microseconds from the profiler's epoch.
+        */
+    struct Event
+    {
+        Phase phase;
+        double start;
+        float duration;
+    };
+
+    /**
+        * The average, smallest and largest of a value over the
+        * frames in the history.
+        */
+    struct Summary
+    {
+        float average;
+        float minimum;
+        float maximum;
+    };
+
+    /**
+        * Times one phase from construction to destruction.
+        */
+    class Scope
+    {
+        ParticleProfiler &profiler;
+        Phase phase;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+        Scope(ParticleProfiler &profiler, Phase phase);
+        ~Scope();
+    };
+
+protected:
+    /**
+        * Holds the time every recorded time is measured from.
+        */
+    std::chrono::steady_clock::time_point epoch;
+
+    /**
+        * Holds the frame being recorded, and each scope timed in it
+        * so far, in a fixed array.
+        */
+    Frame current;
+    std::vector<Event> events;
+    unsigned eventCount;
+
+    /**
+        * Holds the last frames in a ring, the slot the next one goes
+        * in, and how many slots are filled.
+        */
+    std::vector<Frame> history;
+    unsigned historyNext;
+    unsigned historySize;
+
+    /**
+        * Holds the traced frames and their scopes, and whether a
+        * trace is running. The trace stops by itself when its
+        * reserved room is full.
+        */
+    std::vector<Frame> trace;
+    std::vector<Event> traceEvents;
+    bool tracing;
+
+    /**
+        * Holds the number of frames recorded so far.
+        */
+    unsigned frameCount;
+
+    /**
+        * Returns the microseconds from the epoch to the given time.
+        */
+    double since(std::chrono::steady_clock::time_point time) const;
+
+public:
+    /**
+        * Creates a profiler with an empty history.
+        */
+    ParticleProfiler();
+
+    /**
+        * Returns true if the world was built with profiling, that is
+        * with SPHERE_PROFILE defined. If not, nothing is recorded.
+        */
+    static bool isCompiledIn();
+
+    /**
+        * Returns the name of a phase or counter, as used in the trace.
+        */
+    static const char* getPhaseName(Phase phase);
+    static const char* getCounterName(Counter counter);
+
+    /**
+        * Starts and finishes recording a frame.
+        */
+    void beginFrame();
+    void endFrame();
+
+    /**
+        * Records a scope of the given phase from the given start
+        * until now, and adds its time to the phase.
+        */
+    void addPhaseTime(Phase phase, std::chrono::steady_clock::time_point start);
+
+    /**
+        * Sets one of this frame's counts.
+        */
+    void setCounter(Counter counter, unsigned value);
+
+    /**
+        * Starts tracing the next given number of frames, dropping any
+        * earlier trace.
+        */
+    void startTrace(unsigned maxFrames);
+
+    /**
+        * Stops tracing, keeping the frames traced so far.
+        */
+    void stopTrace();
+
+    /**
+        * Returns the number of frames in the trace.
+        */
+    unsigned getTraceSize() const;
+
+    /**
+        * Writes the trace as Chrome trace event JSON: a complete
+        * event for each frame and for each timed scope in it, and a
+        * counter event for each frame's counts.
+        */
+    void writeTrace(std::ostream &out) const;
+
+    /**
+        * Returns the number of frames recorded, and the last one
+        * finished.
+        */
+    unsigned getFrameCount() const;
+    const Frame& getLastFrame() const;
+
+    /**
+        * Returns a phase's time, or a counter, summarised over the
+        * frames in the history. All zero if there are none.
+        */
+    Summary getPhaseSummary(Phase phase) const;
+    Summary getCounterSummary(Counter counter) const;
+
+    /**
+        * Writes the summary of every phase and counter as a table,
+        * times in milliseconds.
+        */
+    void writeSummary(std::ostream &out) const;
+};
+
+/**
+    * The macros the world is instrumented with. They compile to
+    * nothing unless SPHERE_PROFILE is defined.
+    */
+#ifdef SPHERE_PROFILE
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN2(a, b)
+#define PROFILE_SCOPE(profiler, phase) \
+    ParticleProfiler::Scope PROFILE_JOIN(profileScope, __LINE__)(profiler, ParticleProfiler::phase)
+#define PROFILE_BEGIN_FRAME(profiler) (profiler).beginFrame()
+#define PROFILE_END_FRAME(profiler) (profiler).endFrame()
+#define PROFILE_COUNTER(profiler, counter, value) \
+    (profiler).setCounter(ParticleProfiler::counter, (unsigned)(value))
+#else
+#define PROFILE_SCOPE(profiler, phase) ((void)0)
+#define PROFILE_BEGIN_FRAME(profiler) ((void)0)
+#define PROFILE_END_FRAME(profiler) ((void)0)
+#define PROFILE_COUNTER(profiler, counter, value) ((void)0)
+#endif
+
+#endif // PPROFILE_H
@@ -0,0 +1,100 @@
+/*
+ * Interface file for the batched particle renderer.
+ *
+ */
+#ifndef PRENDER_H
+#define PRENDER_H
+
+#include <vector>
+#include "psnapshot.h"
+
+/**
+    * Draws every particle in a snapshot with a single draw call.
+    *
+    * Each frame the particles are packed into one contiguous vertex
+    * array: a screen aligned quad per particle, sized by its radius,
+    * with its colour and the corners of a circle texture. The array is
+    * handed to GL as client arrays and drawn with one glDrawArrays;
+    * alpha testing against the texture cuts each quad down to a disc.
+    * This only needs OpenGL 1.1, so it runs wherever the demo does,
+    * including software renderers without instancing or point sprites.
+    *
+    * Packing doesn't touch GL, so it can run on any thread. Drawing
+    * needs the GL context to be current.
+    */
+class ParticleRenderer
+{
+public:
+    /**
+        * One corner of a particle's quad.
+        */
+    struct Vertex
+    {
+        float x, y;
+        float u, v;
+        unsigned char red, green, blue, alpha;
+    };
+
+    /**
+        * The width and height of the circle texture, in texels.
+        */
+    static const unsigned TEXTURE_SIZE = 64;
+
+protected:
+    /**
+        * Holds the packed quads, four vertices per particle, and how
+        * many particles were packed.
+        */
+    std::vector<Vertex> vertices;
+    unsigned particleCount;
+
+    /**
+        * Holds the circle texture, or zero until the first draw
+        * creates it.
+        */
+    unsigned texture;
+
+    /**
+        * Creates the circle texture in the current context.
+        */
+    void createTexture();
+
+public:
+    /**
+        * Creates an empty renderer. No GL calls are made until the
+        * first draw.
+        */
+    ParticleRenderer();
+
+    /**
+        * Packs the particles in the snapshot, with their positions
+        * blended between the previous and latest step by the given
+        * amount (zero for the previous positions, one for the
+        * latest).
+        */
+    void pack(const ParticleSnapshot &snapshot, float blend = 1.0f);
+
+    /**
+        * Draws the packed particles in one call. Leaves the texture,
+        * alpha test and client array state as it found them.
+        */
+    void draw();
+
+    /**
+        * Deletes the circle texture. Call it with the context current
+        * before the context goes away; the next draw makes a new one.
+        */
+    void releaseTexture();
+
+    /**
+        * Returns the number of particles packed.
+        */
+    unsigned getParticleCount() const;
+
+    /**
+        * Returns the packed vertices, four per particle.
+        */
+    const Vertex* getVertices() const;
+};
+
+#endif // PRENDER_H
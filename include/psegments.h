@@ -0,0 +1,117 @@
+/*
+ * Interface file for the static line segment geometry, held in a
+ * bounding volume hierarchy so particles can be tested against many
+ * segments at once.
+ *
+ */
+#ifndef PSEGMENTS_H
+#define PSEGMENTS_H
+
+#include <vector>
+#include "pcontacts.h"
+#include "pworld.h"
+
+/**
+    * Checks the given particle against the line segment from start
+    * to end and, if it is touching, fills in a contact pushing it
+    * away from the nearest point on the segment. The nearest point
+    * is the start, the end or a point in the middle depending on
+    * where the particle's centre projects onto the line. Returns the
+    * number of contacts written, zero or one.
+    */
+unsigned segmentContact(const Vector2 &start, const Vector2 &end,
+    Particle *particle, float restitution, ParticleContact *contact);
+
+/**
+    * A contact generator for fixed level geometry made of line
+    * segments, checked against every particle in the world.
+    *
+    * The segments are put in a bounding volume hierarchy once, when
+    * build is called after loading them, and never change. Each
+    * particle's bounding box is then run down the tree, so only the
+    * segments near it are tested rather than all of them. It is a
+    * batch generator, so the world can run the queries for different
+    * spans of particles on several threads.
+    */
+class ParticleSegmentGenerator : public ParticleBatchContactGenerator
+{
+public:
+    /**
+        * The most segments kept in one leaf of the tree.
+        */
+    static const unsigned SEGMENTS_PER_LEAF = 4;
+
+protected:
+    /**
+        * A node of the tree: a bounding box around its segments,
+        * and either a range of segments (a leaf) or two children.
+        * The first child always directly follows its parent, so
+        * only the second child's index is stored.
+        */
+    struct Node
+    {
+        float minX, minY, maxX, maxY;
+        unsigned secondChild;
+        unsigned firstSegment;
+        unsigned segmentCount;
+    };
+
+    /**
+        * Holds the restitution given to the contacts.
+        */
+    float restitution;
+
+    /**
+        * Holds the segment end points, in tree order once built.
+        */
+    std::vector<Vector2> segmentStart;
+    std::vector<Vector2> segmentEnd;
+
+    /**
+        * Holds the tree, the root first.
+        */
+    std::vector<Node> nodes;
+
+    /**
+        * Builds the subtree over the segments order[first] to
+        * order[first+count-1], reordering them as it splits, and
+        * returns the index of its root.
+        */
+    unsigned buildNode(std::vector<unsigned> &order, unsigned first, unsigned count);
+
+public:
+    /**
+        * Creates a generator with no segments for the given world.
+        */
+    ParticleSegmentGenerator(ParticleWorld *world, float restitution);
+
+    /**
+        * Adds a segment. Call build once all of them are added.
+        */
+    void addSegment(const Vector2 &start, const Vector2 &end);
+
+    /**
+        * Builds the tree over the segments added so far.
+        */
+    void build();
+
+    /**
+        * Returns the number of segments.
+        */
+    unsigned getSegmentCount() const;
+
+    /**
+        * Returns the number of nodes in the tree.
+        */
+    unsigned getNodeCount() const;
+
+    /**
+        * Checks the given particles against the tree.
+        */
+    virtual unsigned addContactBatch(Particle *const *batch,
+                                     unsigned count,
+                                     ParticleContact *contact,
+                                     unsigned limit) const;
+};
+
+#endif // PSEGMENTS_H
@@ -0,0 +1,138 @@
+/*
+ * Interface file for the published copies of the particle state that
+ * other threads can read while the simulation runs.
+ *
+ */
+#ifndef PSNAPSHOT_H
+#define PSNAPSHOT_H
+
+#include <vector>
+#include <atomic>
+#include "pstore.h"
+
+/**
+    * A copy of the drawable particle state after one frame. Nothing
+    * writes to a snapshot while a reader holds it.
+    */
+struct ParticleSnapshot
+{
+    /**
+        * Counts the snapshots published, starting from one.
+        */
+    unsigned frame;
+
+    /**
+        * A time chosen by whoever published the snapshot, for
+        * example the real time the state belongs to.
+        */
+    double stamp;
+
+    /**
+        * The positions this frame and at the previous snapshot, for
+        * blending between the two. Particles that didn't exist at
+        * the previous snapshot have the same position in both.
+        */
+    std::vector<float> positionX;
+    std::vector<float> positionY;
+    std::vector<float> previousX;
+    std::vector<float> previousY;
+
+    /**
+        * The size and colour of each particle.
+        */
+    std::vector<float> radius;
+    std::vector<float> red;
+    std::vector<float> green;
+    std::vector<float> blue;
+
+    /**
+        * Returns the number of particles in the snapshot.
+        */
+    unsigned size() const { return (unsigned)positionX.size(); }
+};
+
+/**
+    * Passes snapshots from the simulation thread to any number of
+    * reader threads without either side taking a lock or waiting.
+    *
+    * There are three snapshots. One is the latest published, and the
+    * publisher fills one of the other two and then makes it the
+    * latest with an atomic store. Readers pin the latest by bumping
+    * its reader count, and the publisher never writes into a pinned
+    * snapshot. With one reader there is always a free snapshot to
+    * write; with several readers holding two different old
+    * snapshots at once, the publish is skipped rather than waiting.
+    */
+class ParticleSnapshotBuffer
+{
+public:
+    /**
+        * Marks that nothing has been published yet.
+        */
+    static const unsigned NONE = 3;
+
+protected:
+    /**
+        * Holds the three snapshots.
+        */
+    ParticleSnapshot snapshots[3];
+
+    /**
+        * Holds the number of readers holding each snapshot.
+        */
+    std::atomic<unsigned> readers[3];
+
+    /**
+        * Holds the index of the latest snapshot, or NONE.
+        */
+    std::atomic<unsigned> latest;
+
+    /**
+        * Holds the number of snapshots published and skipped.
+        */
+    std::atomic<unsigned> published;
+    std::atomic<unsigned> skipped;
+
+private:
+    ParticleSnapshotBuffer(const ParticleSnapshotBuffer&);
+    ParticleSnapshotBuffer& operator=(const ParticleSnapshotBuffer&);
+
+public:
+    /**
+        * Creates an empty buffer.
+        */
+    ParticleSnapshotBuffer();
+
+    /**
+        * Copies the store into a free snapshot and makes it the
+        * latest. Only one thread may publish. Returns false if every
+        * free snapshot was held by a reader and nothing was
+        * published.
+        */
+    bool publish(const ParticleStore &store, double stamp);
+
+    /**
+        * Returns the latest snapshot and holds it until release is
+        * called, or returns null if nothing has been published.
+        * Safe to call from any thread.
+        */
+    const ParticleSnapshot* acquire();
+
+    /**
+        * Lets go of a snapshot returned by acquire.
+        */
+    void release(const ParticleSnapshot *snapshot);
+
+    /**
+        * Returns the number of snapshots published.
+        */
+    unsigned getPublishedCount() const;
+
+    /**
+        * Returns the number of publishes skipped because the
+        * readers held every free snapshot.
+        */
+    unsigned getSkippedCount() const;
+};
+
+#endif // PSNAPSHOT_H
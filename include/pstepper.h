@@ -0,0 +1,159 @@
+/*
+ * Interface file for the fixed timestep simulation thread.
+ *
+ */
+#ifndef PSTEPPER_H
+#define PSTEPPER_H
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include "pworld.h"
+
+/**
+    * Runs a particle world on its own thread at a fixed timestep,
+    * independent of how often (or how late) the display asks for a
+    * frame.
+    *
+    * Real time is fed into an accumulator and the step function is
+    * called once for every whole timestep in it, so the simulation
+    * always advances in the same sized steps whatever the frame
+    * rate. If the simulation falls more than a few steps behind
+    * (say the machine was suspended) the backlog is dropped rather
+    * than run, so it can't spiral.
+    *
+    * After every step the world publishes a snapshot, stamped with
+    * the real time the step was due. Readers on other threads blend
+    * each snapshot's positions with the previous ones by how far
+    * real time has got into the next step, so motion looks smooth
+    * even when the display and simulation rates don't match.
+    */
+class ParticleStepper
+{
+public:
+    /**
+        * Called on the simulation thread for every step, with the
+        * step duration. Normally runs the world's physics and any
+        * game logic that goes with it.
+        */
+    typedef std::function<void (float)> StepFunction;
+
+protected:
+    typedef std::chrono::steady_clock Clock;
+
+    /**
+        * Holds the world that publishes the snapshots.
+        */
+    ParticleWorld *world;
+
+    /**
+        * Holds the fixed duration of each step, in seconds.
+        */
+    float stepDuration;
+
+    /**
+        * Holds the most steps run to catch up before the rest of
+        * the backlog is dropped.
+        */
+    unsigned maxCatchUpSteps;
+
+    /**
+        * Holds the simulation thread and the function it steps.
+        */
+    std::thread thread;
+    StepFunction step;
+    std::atomic<bool> running;
+
+    /**
+        * Holds the number of steps taken since start.
+        */
+    std::atomic<unsigned> stepCount;
+
+    /**
+        * Holds the real time the snapshot stamps count from.
+        */
+    Clock::time_point epoch;
+
+    /**
+        * The main loop of the simulation thread.
+        */
+    void run();
+
+    /**
+        * Publishes the world's state as due at the given time.
+        */
+    void publish(Clock::time_point due);
+
+private:
+    ParticleStepper(const ParticleStepper&);
+    ParticleStepper& operator=(const ParticleStepper&);
+
+public:
+    /**
+        * Creates a stepper for the given world, taking steps of the
+        * given duration in seconds. Nothing runs until start.
+        */
+    ParticleStepper(ParticleWorld *world, float stepDuration);
+
+    /**
+        * Stops the simulation thread.
+        */
+    ~ParticleStepper();
+
+    /**
+        * Starts the simulation thread, calling the given function
+        * once per step. Does nothing if it is already running.
+        */
+    void start(const StepFunction &step);
+
+    /**
+        * Stops the simulation thread and waits for the step in
+        * progress to finish.
+        */
+    void stop();
+
+    /**
+        * Returns true if the simulation thread is running.
+        */
+    bool isRunning() const;
+
+    /**
+        * Sets the step duration. Only takes effect at the next
+        * start.
+        */
+    void setStepDuration(float duration);
+
+    /**
+        * Returns the step duration.
+        */
+    float getStepDuration() const;
+
+    /**
+        * Sets the most steps run in one go to catch up.
+        */
+    void setMaxCatchUpSteps(unsigned steps);
+
+    /**
+        * Returns the number of steps taken since start.
+        */
+    unsigned getStepCount() const;
+
+    /**
+        * Returns how far from the given snapshot's previous positions
+        * to its current ones to draw right now, from 0 to 1.
+        */
+    float getBlend(const ParticleSnapshot &snapshot) const;
+
+    /**
+        * Fills the given arrays with the particle positions from the
+        * latest snapshot, blended for the current time, in particle
+        * order. Returns the blend factor used. Safe to call from any
+        * thread while the simulation runs.
+        */
+    float getInterpolatedPositions(std::vector<float> &x,
+        std::vector<float> &y) const;
+};
+
+#endif // PSTEPPER_H
@@ -0,0 +1,123 @@
+/*
+ * Interface file for the structure-of-arrays particle store.
+ *
+ */
+#ifndef PSTORE_H
+#define PSTORE_H
+
+#include <vector>
+
+class Particle;
+
+/**
+    * Holds the data for a set of particles as one contiguous array
+    * per field, so the loops that run over every particle each frame
+    * (integration, the broadphase) stream through the fields they
+    * use and nothing else. The hot fields come first; the colour,
+    * ID and collision flag are only touched by the application.
+    *
+    * Particles are addressed either by index into the arrays or
+    * through a Particle handle, which keeps the usual accessor API
+    * and reads and writes the arrays underneath. Handles stay valid
+    * for the lifetime of the store. They are built in slabs of
+    * PARTICLES_PER_SLAB, so creating a particle only allocates once
+    * a slab fills, and neighbouring handles share cache lines.
+    */
+class ParticleStore
+{
+public:
+    typedef std::vector<Particle*> Handles;
+
+    /**
+        * The number of handles allocated together.
+        */
+    static const unsigned PARTICLES_PER_SLAB = 256;
+
+    /**
+        * Hot per particle data, read and written every frame.
+        */
+    std::vector<float> inverseMass;
+    std::vector<float> damping;
+    std::vector<float> radius;
+    std::vector<float> positionX;
+    std::vector<float> positionY;
+    std::vector<float> velocityX;
+    std::vector<float> velocityY;
+    std::vector<float> forceAccumX;
+    std::vector<float> forceAccumY;
+    std::vector<float> accelerationX;
+    std::vector<float> accelerationY;
+
+    /**
+        * Sleep state. Sleeping particles are left out of integration
+        * and hold still until something wakes them. The average
+        * velocity is smoothed over the world's sleep window, and the
+        * sleep time is how long it has been slow enough to sleep.
+        */
+    std::vector<unsigned char> awake;
+    std::vector<float> averageVelocityX;
+    std::vector<float> averageVelocityY;
+    std::vector<float> sleepTime;
+
+    /**
+        * Cold per particle data, only used by the application.
+        */
+    std::vector<int> ID;
+    std::vector<unsigned char> collisionStatus;
+    std::vector<float> red;
+    std::vector<float> green;
+    std::vector<float> blue;
+
+protected:
+    /**
+        * Holds one handle per particle, in index order.
+        */
+    Handles handles;
+
+    /**
+        * Holds the memory the handles are built in, each slab room
+        * for PARTICLES_PER_SLAB of them.
+        */
+    std::vector<Particle*> slabs;
+
+private:
+    // The handles point back at the store, so it can't be copied.
+    ParticleStore(const ParticleStore&);
+    ParticleStore& operator=(const ParticleStore&);
+
+public:
+    /**
+        * Creates an empty store.
+        */
+    ParticleStore();
+
+    /**
+        * Deletes the store, all the handles it gave out and their
+        * slabs.
+        */
+    ~ParticleStore();
+
+    /**
+        * Adds a new particle at rest at the origin, with no damping
+        * and infinite mass, and returns its handle.
+        */
+    Particle* create();
+
+    /**
+        * Makes room for the given number of particles, so creating
+        * that many allocates nothing more.
+        */
+    void reserve(unsigned count);
+
+    /**
+        * Returns the number of particles in the store.
+        */
+    unsigned size() const;
+
+    /**
+        * Returns the handles of all the particles, in index order.
+        */
+    const Handles& getHandles() const;
+};
+
+#endif // PSTORE_H
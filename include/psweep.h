@@ -0,0 +1,96 @@
+/*
+ * Interface file for the sort and sweep broadphase, an alternative to
+ * the spatial hash grid for scenes that change little between frames.
+ *
+ */
+#ifndef PSWEEP_H
+#define PSWEEP_H
+
+#include <vector>
+#include "pgrid.h"
+
+/**
+    * Keeps the particles sorted along the x axis by the low end of
+    * their bounding boxes, and finds overlapping pairs by sweeping
+    * along that order: each particle only needs checking against the
+    * ones that start before its own box ends.
+    *
+    * The order is kept between frames. Particles move little in one
+    * step, so the order from the last frame is almost sorted already
+    * and an insertion sort puts it right in close to linear time,
+    * rather than rebuilding a structure from scratch every frame.
+    * Scenes where particles overtake each other a lot along x (or
+    * that are tall and thin) are better served by the grid.
+    */
+class ParticleSweepAndPrune
+{
+public:
+    typedef ParticleGrid::ParticlePairs ParticlePairs;
+
+protected:
+    /**
+        * Holds the store the order was last updated from.
+        */
+    const ParticleStore *store;
+
+    /**
+        * Holds the particle indices in sorted order.
+        */
+    std::vector<unsigned> order;
+
+    /**
+        * Holds the bounding box data of each particle in sorted
+        * order, so the sweep reads straight through memory: the low
+        * and high x of the box, the centre and the radius.
+        */
+    std::vector<float> sortedMinX;
+    std::vector<float> sortedMaxX;
+    std::vector<float> sortedX;
+    std::vector<float> sortedY;
+    std::vector<float> sortedRadius;
+
+    /**
+        * Holds how much each particle's box is grown by on each side,
+        * or null for none.
+        */
+    const std::vector<float> *margins;
+
+    /**
+        * Holds the number of moves the last insertion sort made.
+        */
+    unsigned swaps;
+
+public:
+    /**
+        * Creates an empty broadphase.
+        */
+    ParticleSweepAndPrune();
+
+    /**
+        * Brings the sorted order up to date with the given particles.
+        * Particles added since the last update are put at the end
+        * and sorted into place.
+        */
+    void update(const ParticleStore &store);
+
+    /**
+        * Sets how much each particle's box is grown by on each side,
+        * as ParticleGrid::setMargins. Read at the next update.
+        */
+    void setMargins(const std::vector<float> *margins);
+
+    /**
+        * Fills the given list with every pair of particles whose
+        * bounding boxes overlap. The list is cleared first. Each pair
+        * is reported once, with the lower index first.
+        */
+    void findPairs(ParticlePairs &pairs) const;
+
+    /**
+        * Returns the number of moves the last update's sort made, a
+        * measure of how much the order changed.
+        */
+    unsigned getSwapCount() const;
+};
+
+#endif // PSWEEP_H
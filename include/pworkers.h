@@ -0,0 +1,219 @@
+/*
+ * Interface file for the persistent worker thread pool used to
+ * spread the physics phases over several cores.
+ *
+ */
+#ifndef PWORKERS_H
+#define PWORKERS_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+/**
+    * A fixed set of worker threads that stay alive between frames and
+    * run parallel loops on request. The thread calling parallelFor
+    * takes part in the loop too, so a pool of N threads starts N-1
+    * workers, and a pool of one thread runs everything inline.
+    *
+    * Only one loop runs at a time. A parallelFor issued while another
+    * is in progress (from another thread, or from inside a loop body)
+    * simply runs on the calling thread. An indexed loop run that way
+    * is given the spare index getThreadCount(), which no thread of
+    * the running loop uses, so per thread buffers need
+    * getThreadSlots() entries.
+    */
+class WorkerPool
+{
+public:
+    /**
+        * The loop body, called with a half open range [begin, end).
+        */
+    typedef std::function<void (unsigned, unsigned)> RangeFunction;
+
+    /**
+        * A loop body that is also told which thread it is running
+        * on, from zero (the caller) to getThreadCount()-1. Useful for
+        * writing into per thread buffers.
+        */
+    typedef std::function<void (unsigned, unsigned, unsigned)> ThreadRangeFunction;
+
+    /**
+        * The number of floats in a cache line. Chunks are made a
+        * multiple of this so two threads never write to the same
+        * line of a float array, except where a range starts part
+        * way through one.
+        */
+    static const unsigned CACHE_LINE_FLOATS = 16;
+
+protected:
+    /**
+        * Holds the worker threads.
+        */
+    std::vector<std::thread> threads;
+
+    /**
+        * Guards the state shared with the workers below, and wakes
+        * them up or reports back when they have finished.
+        */
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    /**
+        * Incremented for every loop, so the workers can tell a new
+        * one has been posted.
+        */
+    unsigned generation;
+
+    /**
+        * Holds the number of workers still running the current loop.
+        */
+    unsigned active;
+
+    /**
+        * Set to make the workers exit.
+        */
+    bool stopping;
+
+    /**
+        * Held for the length of a parallel loop.
+        */
+    std::mutex dispatch;
+
+    /**
+        * Counts the indexed loops running inline on the spare index,
+        * which only one may use at a time.
+        */
+    std::atomic<unsigned> spareUsers;
+
+    /**
+        * Calls a loop body of some type, passed as a pointer to it.
+        */
+    typedef void (*BodyCall)(const void *body, unsigned begin, unsigned end, unsigned thread);
+
+    /**
+        * The current loop, and how to call it. Chunks are handed out
+        * by bumping next.
+        */
+    const void *body;
+    BodyCall bodyCall;
+    std::atomic<unsigned> next;
+    unsigned end;
+    unsigned grain;
+
+    /**
+        * Takes chunks of the current loop until there are none left.
+        */
+    void runChunks(unsigned threadIndex);
+
+    /**
+        * The main loop of each worker thread. The worker waits for
+        * the first loop posted after the given generation.
+        */
+    void workerMain(unsigned threadIndex, unsigned seen);
+
+    /**
+        * Runs a loop whose body is reached through the given call.
+        * The body is only borrowed for the length of the loop.
+        */
+    void run(unsigned begin, unsigned end, unsigned grain,
+        const void *body, BodyCall bodyCall, bool indexed);
+
+    /**
+        * Calls a body of the given type, with or without the thread
+        * index.
+        */
+    template <class Body>
+    static void callRange(const void *body, unsigned begin, unsigned end, unsigned)
+    {
+        (*static_cast<const Body*>(body))(begin, end);
+    }
+
+    template <class Body>
+    static void callThreadRange(const void *body, unsigned begin, unsigned end, unsigned thread)
+    {
+        (*static_cast<const Body*>(body))(begin, end, thread);
+    }
+
+    /**
+        * Starts or stops workers so there are the given number.
+        */
+    void startThreads(unsigned count);
+    void stopThreads();
+
+private:
+    WorkerPool(const WorkerPool&);
+    WorkerPool& operator=(const WorkerPool&);
+
+public:
+    /**
+        * Creates a pool with the given number of threads, including
+        * the caller. Zero means one per hardware thread.
+        */
+    WorkerPool(unsigned threadCount = 1);
+
+    /**
+        * Stops and joins the workers.
+        */
+    ~WorkerPool();
+
+    /**
+        * Changes the number of threads, including the caller. Zero
+        * means one per hardware thread. Must not be called from
+        * inside a loop.
+        */
+    void setThreadCount(unsigned threadCount);
+
+    /**
+        * Returns the number of threads, including the caller.
+        */
+    unsigned getThreadCount() const;
+
+    /**
+        * Returns the number of thread indices an indexed loop body
+        * can be given: one per thread, and the spare one.
+        */
+    unsigned getThreadSlots() const;
+
+    /**
+        * Works out a chunk size for a loop over the given number of
+        * elements: about four chunks per thread so the load
+        * balances, rounded up to whole cache lines.
+        */
+    unsigned chunkSize(unsigned count) const;
+
+    /**
+        * Runs the body over [begin, end) split into chunks of the
+        * given size, and returns once every chunk is done. A grain
+        * of zero uses chunkSize. The body can be a RangeFunction or
+        * any other callable, such as a lambda; it is called where it
+        * is rather than copied, so nothing is allocated per loop.
+        */
+    template <class Body>
+    void parallelFor(unsigned begin, unsigned end, unsigned grain,
+        const Body &body)
+    {
+        run(begin, end, grain, &body, &callRange<Body>, false);
+    }
+
+    /**
+        * As parallelFor, but the body is also given the index of the
+        * thread running it, below getThreadSlots(). A loop that has
+        * the pool to itself but runs inline is given zero. One that
+        * runs inline because another loop holds the pool is given
+        * the spare index, and must not overlap another such loop:
+        * debug builds assert that it doesn't.
+        */
+    template <class Body>
+    void parallelForIndexed(unsigned begin, unsigned end, unsigned grain,
+        const Body &body)
+    {
+        run(begin, end, grain, &body, &callThreadRange<Body>, true);
+    }
+};
+
+#endif // PWORKERS_H
@@ -7,19 +7,150 @@
 
 #include <vector> 
 #include "pcontacts.h"
+#include "parena.h"
+#include "pcache.h"
+#include "pgrid.h"
+#include "psweep.h"
+#include "pworkers.h"
+#include "pcolour.h"
+#include "pheap.h"
+#include "pjacobi.h"
+#include "pislands.h"
+#include "pintegrator.h"
+#include "psnapshot.h"
+#include "pprofile.h"
 
 
 class ParticleWorld
 {
     public:
-        typedef std::vector<Particle*> Particles;
+        typedef ParticleStore::Handles Particles;
         typedef std::vector<ParticleContactGenerator*> ContactGenerators;
+        typedef ParticleGrid::ParticlePairs ParticlePairs;
+
+        /**
+         * The smallest distance apart at which position based
+         * stepping generates contacts between particles.
+         */
+        static const float SPECULATIVE_MARGIN_FLOOR;
+
+        /**
+         * The ways the world can resolve its contacts.
+         */
+        enum ResolverMode
+        {
+            /** One contact at a time, worst first. */
+            RESOLVE_SEQUENTIAL,
+
+            /** Batches of independent contacts on the worker threads. */
+            RESOLVE_COLOURED,
+
+            /**
+             * As sequential, but keeping the contacts in a heap so
+             * each step only re-checks the contacts that changed.
+             */
+            RESOLVE_INDEXED,
+
+            /**
+             * Every contact at once from the same velocities, with
+             * the changes averaged and applied together.
+             */
+            RESOLVE_JACOBI,
+
+            /**
+             * Each group of touching particles on its own, as
+             * sequential, with the groups spread over the worker
+             * threads.
+             */
+            RESOLVE_ISLANDS
+        };
+
+        /**
+         * The ways the world can find candidate pairs.
+         */
+        enum BroadphaseMode
+        {
+            /** A spatial hash grid rebuilt every frame. */
+            BROADPHASE_GRID,
+
+            /**
+             * Sort and sweep along x, keeping the order between
+             * frames. Best when particles move little per step.
+             */
+            BROADPHASE_SWEEP
+        };
+
+        /**
+         * The ways the world can integrate its particles, each one of
+         * the policies in pintegrator.h.
+         */
+        enum IntegratorMode
+        {
+            /** Move with the old velocity, then accelerate. */
+            INTEGRATE_EULER,
+
+            /** Accelerate, then move with the new velocity. */
+            INTEGRATE_SYMPLECTIC_EULER,
+
+            /** Velocity Verlet, exact for constant accelerations. */
+            INTEGRATE_VERLET
+        };
+
+        /**
+         * The ways runPhysics can step the world.
+         */
+        enum StepMode
+        {
+            /**
+             * One integration per frame, then the contacts resolved
+             * with impulses by the resolver in use.
+             */
+            STEP_IMPULSES,
+
+            /**
+             * Position based: over a number of substeps, predict the
+             * positions, push the contacts apart as position
+             * constraints and take the velocities from how far the
+             * particles moved. Stays stable in dense piles at much
+             * larger frame steps.
+             */
+            STEP_POSITIONS
+        };
 
     protected:
         /**
-         * Holds the particles
+         * One partition of one contact generator, as run by the
+         * parallel contact generation. Records where the partition
+         * put its contacts in its thread's buffer, and where they go
+         * in the merged contact array.
          */
-        Particles particles;
+        struct ContactTask
+        {
+            ParticleContactGenerator *generator;
+            unsigned partition;
+            unsigned thread;
+            unsigned offset;
+            unsigned count;
+            unsigned output;
+        };
+
+        /**
+         * A contact buffer used by one thread during parallel
+         * contact generation. Padded so the used counts of different
+         * threads sit on different cache lines.
+         */
+        struct ContactBuffer
+        {
+            std::vector<ParticleContact> contacts;
+            unsigned used;
+            char padding[64];
+        };
+
+    protected:
+        /**
+         * Holds the particles, one array per field.
+         */
+        ParticleStore store;
 
         /**
          * True if the world should calculate the number of iterations
@@ -32,27 +163,264 @@ class ParticleWorld
          */
         ParticleContactResolver resolver;
 
+        /**
+         * Holds the alternative resolvers, and which resolver is in
+         * use.
+         */
+        ParticleColouredResolver colouredResolver;
+        ParticleHeapResolver heapResolver;
+        ParticleJacobiResolver jacobiResolver;
+        ParticleIslands islands;
+        ResolverMode resolverMode;
+
+        /**
+         * Holds the integration policy runPhysics uses.
+         */
+        IntegratorMode integratorMode;
+
+        /**
+         * Holds how runPhysics steps the world, and the number of
+         * substeps for position based stepping.
+         */
+        StepMode stepMode;
+        unsigned substepCount;
+
+        /**
+         * Holds the adaptive stepping settings: the fraction of its
+         * radius a particle may move in one step, or zero to take
+         * each frame in one step, and the most steps a frame may be
+         * split into. Also holds the steps the last frame took.
+         */
+        float stepFraction;
+        unsigned maxStepCount;
+        unsigned stepCount;
+
+        /**
+         * Holds the counts of the last frame, added up over the
+         * steps it was split into.
+         */
+        unsigned framePairs;
+        unsigned frameContacts;
+        unsigned frameDropped;
+        unsigned frameIterations;
+
+        /**
+         * Holds the resolver whose interpenetration passes solve the
+         * contacts in position based stepping, kept apart so its
+         * passes and tolerance can be tuned on their own.
+         */
+        ParticleContactResolver positionResolver;
+
+        /**
+         * Scratch space for position based stepping: the positions
+         * at the start of the substep, and how fast each contact was
+         * closing before it was solved.
+         */
+        std::vector<float> previousX;
+        std::vector<float> previousY;
+        std::vector<float> closingSpeed;
+
+        /**
+         * Scratch space for position based stepping: how far each
+         * particle can travel in the frame, how much sooner than
+         * touching its contacts are generated, and the true radii
+         * while they are grown by that margin.
+         */
+        std::vector<float> travel;
+        std::vector<float> contactMargin;
+        std::vector<float> savedRadius;
+
         /**
          * Contact generators.
          */
         ContactGenerators contactGenerators;
 
         /**
-         * Holds the list of contacts.
+         * Holds the list of contacts, growing as needed.
+         */
+        ParticleContactArena contacts;
+
+        /**
+         * Holds the most contacts resolved in a frame, or zero for
+         * no limit.
+         */
+        unsigned contactLimit;
+
+        /**
+         * Holds last frame's contact impulses, and whether they are
+         * used to warm start this frame's contacts.
+         */
+        ParticleContactCache contactCache;
+        bool warmStarting;
+
+        /**
+         * True if slow particles are put to sleep. A particle's
+         * velocity is averaged over the sleep window, in seconds, so
+         * the jitter of a resting contact cancels out. It sleeps once
+         * the kinetic energy per unit mass of that average has stayed
+         * below the sleep energy for a whole window.
+         */
+        bool sleeping;
+        float sleepEnergy;
+        float sleepWindow;
+
+        /**
+         * True if, when the contacts are resolved by island, each
+         * island sleeps as a unit rather than particle by particle.
+         */
+        bool islandSleeping;
+        unsigned awakeCount;
+
+        /**
+         * Holds the sleeping particles pinned in place while this
+         * frame's contacts are resolved, and their inverse masses.
+         */
+        std::vector<unsigned> pinnedParticles;
+        std::vector<float> pinnedInverseMass;
+
+        /**
+         * Holds, for each island this frame, whether every particle
+         * in it is ready to sleep.
+         */
+        std::vector<unsigned char> islandReady;
+
+        /**
+         * Holds the broadphase grid, rebuilt once per frame, the
+         * sort and sweep alternative, and which one is in use.
+         */
+        ParticleGrid grid;
+        ParticleSweepAndPrune sweep;
+        BroadphaseMode broadphaseMode;
+
+        /**
+         * Holds the particle pairs the broadphase found this frame.
+         */
+        ParticlePairs candidatePairs;
+
+        /**
+         * Per particle factors used by the batched integration,
+         * rebuilt from the store at the start of each integrate
+         * call. The drag factor pow(damping, duration) is cached and
+         * only recomputed when the damping or the duration changes.
+         */
+        std::vector<float> integrationMask;
+        std::vector<float> forceScale;
+        std::vector<float> dragFactor;
+        std::vector<float> dragDamping;
+        float dragDuration;
+
+        /**
+         * Holds the worker threads the physics phases are spread
+         * over. Single threaded unless setThreadCount is called.
+         */
+        WorkerPool workers;
+
+        /**
+         * True if contacts should be generated on the worker threads.
+         */
+        bool parallelContacts;
+
+        /**
+         * Scratch space for the parallel contact generation, kept
+         * between frames.
+         */
+        std::vector<ContactTask> contactTasks;
+        std::vector<ContactBuffer> contactBuffers;
+
+        /**
+         * Holds the published copies of the particle state.
+         */
+        ParticleSnapshotBuffer snapshots;
+
+        /**
+         * Holds the phase times and counts of the last frames. Only
+         * filled in when built with SPHERE_PROFILE.
+         */
+        ParticleProfiler profiler;
+
+        /**
+         * Runs every partition of every contact generator on the
+         * worker threads, each writing into its thread's own buffer,
+         * then merges the buffers into the contact arena in
+         * generator order.
+         */
+        unsigned generateContactsParallel();
+
+        /**
+         * Integrates the particles in the range [begin, end). Ranges
+         * that don't overlap can run at the same time.
+         */
+        void integrateRange(unsigned begin, unsigned end, const IntegrationStep &step,
+            bool predict, bool keepForces);
+
+        /**
+         * Steps the world once with impulses, everything but the
+         * sleep update. The forces are kept if the frame has more
+         * steps to come.
+         */
+        void stepImpulses(float duration, bool keepForces);
+
+        /**
+         * Clears every particle's force accumulator.
+         */
+        void clearForces();
+
+        /**
+         * Steps the world over the given number of substeps with
+         * position constraints, everything but the sleep update.
+         */
+        void stepPositions(float duration, unsigned substeps);
+
+        /**
+         * Returns the number of steps the given frame needs for no
+         * awake particle to move further than the step fraction of
+         * its radius in one, at its current speed.
          */
-        ParticleContact *contacts;
+        unsigned findStepCount(float duration) const;
 
         /**
-         * Holds the maximum number of contacts allowed (i.e. the
-         * size of the contacts array).
+         * Returns the number of iterations (or sweeps) the impulse
+         * resolver in use took the last time it ran.
          */
-        unsigned maxContacts;
+        unsigned getResolverIterationsUsed() const;
+
+        /**
+         * Works out how far each particle could travel in the given
+         * time, into the travel array, and returns the largest
+         * acceleration.
+         */
+        float findTravel(float duration);
+
+        /**
+         * Wakes the sleeping particles a moving particle has run
+         * into over the given step, then drops the contacts with
+         * nothing awake in them. The sleeping particles left in a
+         * contact are given infinite mass until
+         * restorePinnedParticles, so the resolver treats them as
+         * fixed. Returns the number of contacts left.
+         */
+        unsigned wakeContacts(ParticleContact *contactArray, unsigned numContacts, float duration);
+
+        /**
+         * Gives the particles wakeContacts pinned their mass back.
+         */
+        void restorePinnedParticles();
+
+        /**
+         * Gives any pinned particles their mass back, then updates
+         * the average velocities and sleep timers after the contacts
+         * are resolved, putting particles that have been slow for
+         * long enough to sleep. With island sleeping, the particles
+         * in an island only sleep once they are all ready to.
+         */
+        void updateSleep(float duration);
 
     public:
 
         /**
-         * Creates a new particle simulator that can handle up to the
-         * given number of contacts per frame. 
+         * Creates a new particle simulator, with room for the given
+         * number of contacts to start with. The room grows if a
+         * frame needs more.
          */
         ParticleWorld(unsigned maxContacts, unsigned iterations=0);
 
@@ -64,30 +432,276 @@ class ParticleWorld
         /**
          * Calls each of the registered contact generators to report
          * their contacts. Returns the number of generated contacts.
+         * The contact arena grows to hold them all. If a contact
+         * limit is set and there are more, the ones from the later
+         * generators are dropped (and counted by the arena), whether
+         * the contacts are generated in parallel or not.
          */
         unsigned generateContacts();
 
         /**
          * Integrates all the particles in this world forward in time
-         * by the given duration.
+         * by the given duration. This runs straight over the store's
+         * arrays rather than through the particle handles, using the
+         * batch kernels from coreMath.h, split into chunks over the
+         * worker threads. When predicting for position based
+         * stepping, the velocities always update before the
+         * positions. Unless asked to keep them for the frame's next
+         * step, the forces are cleared.
+         */
+        void integrate(float duration, bool predict = false, bool keepForces = false);
+
+        /**
+         * Brings the broadphase up to date with the current particle
+         * positions and collects the candidate pairs for this frame.
          */
-        void integrate(float duration);
+        void broadphase();
 
         /**
-         * Processes all the physics for the particle world.
+         * Processes all the physics for the particle world. With
+         * adaptive stepping on, a fast frame is split into as many
+         * shorter steps as it needs.
          */
         void runPhysics(float duration);
 		
+        /**
+         * Adds a new particle to the world and returns its handle.
+         * The world owns the particle.
+         */
+        Particle* createParticle();
+
         /**
          *  Returns the list of particles.
          */
-        Particles& getParticles();
+        const Particles& getParticles() const;
+
+        /**
+         * Returns the store holding the particle data.
+         */
+        ParticleStore& getParticleStore();
 
         /**
          * Returns the list of contact generators.
          */
         ContactGenerators& getContactGenerators();
 
+        /**
+         * Returns the pairs of particles found close enough to touch
+         * by the last broadphase. The indices refer to the particle
+         * list. When a frame is split into several steps, these are
+         * the pairs of its last step.
+         */
+        const ParticlePairs& getCandidatePairs() const;
+
+        /**
+         * Returns the number of candidate pairs the last frame found,
+         * added up over the steps it was split into.
+         */
+        unsigned getPairCount() const;
+
+        /**
+         * Sets the number of threads the world uses, including the
+         * one calling runPhysics. Zero means one per hardware thread.
+         */
+        void setThreadCount(unsigned threadCount);
+
+        /**
+         * Returns the world's worker pool, so other phases of a frame
+         * can run their own parallel loops on the same threads.
+         */
+        WorkerPool& getWorkerPool();
+
+        /**
+         * Sets whether contacts are generated on the worker threads.
+         * Generators that report more than one partition get their
+         * partitions spread over the threads too.
+         */
+        void setParallelContactGeneration(bool parallel);
+
+        /**
+         * Sets the most contacts resolved in a frame. Zero, the
+         * default, resolves every contact generated.
+         */
+        void setContactLimit(unsigned limit);
+
+        /**
+         * Returns the contact arena, with the contacts from the last
+         * frame and its peak and dropped counts.
+         */
+        const ParticleContactArena& getContactArena() const;
+
+        /**
+         * Sets whether each contact starts from the impulse its
+         * match needed last frame. The sequential, indexed, island
+         * and coloured resolvers support this; the Jacobi resolver
+         * always starts from nothing.
+         */
+        void setWarmStarting(bool warmStarting);
+
+        /**
+         * Sets the closing velocity below which every resolver
+         * leaves a contact alone.
+         */
+        void setVelocityTolerance(float tolerance);
+
+        /**
+         * Returns the contact cache, to tune the warm start.
+         */
+        ParticleContactCache& getContactCache();
+
+        /**
+         * Returns the number of iterations (or sweeps) the resolver
+         * in use took last frame, added up over the steps (or
+         * substeps) it was split into.
+         */
+        unsigned getIterationsUsed() const;
+
+        /**
+         * Sets whether particles that come to rest are put to sleep.
+         * Sleeping particles aren't integrated, pairs of them are
+         * skipped by the broadphase and their contacts with the
+         * scenery aren't resolved. A particle wakes when a force is
+         * added, its velocity is set, or an awake particle that isn't
+         * at rest runs into it. Turning sleeping
+         * off wakes everything.
+         */
+        void setSleeping(bool sleeping);
+
+        /**
+         * Sets the kinetic energy per unit mass below which a particle
+         * counts as at rest, and the time its velocity is averaged
+         * over, which is also how long it has to stay at rest before
+         * it sleeps.
+         */
+        void setSleepEnergy(float energy);
+        void setSleepWindow(float window);
+
+        /**
+         * Sets whether each island sleeps as a unit, once every
+         * particle in it has been at rest for the sleep window, when
+         * the contacts are resolved by island. Off by default: a
+         * large pile rarely has every particle at rest at once, while
+         * particle by particle its lower layers sleep first and the
+         * rest settle onto them.
+         */
+        void setIslandSleeping(bool islandSleeping);
+
+        /**
+         * Returns the number of particles awake after the last frame.
+         */
+        unsigned getAwakeCount() const;
+
+        /**
+         * Sets which broadphase runPhysics uses.
+         */
+        void setBroadphaseMode(BroadphaseMode mode);
+
+        /**
+         * Sets which resolver runPhysics uses.
+         */
+        void setResolverMode(ResolverMode mode);
+
+        /**
+         * Sets which integration policy runPhysics uses. Each one is
+         * compiled into its own loop, with a separate loop for when
+         * nothing in a chunk has drag, so the choice is made once
+         * per chunk rather than per particle.
+         */
+        void setIntegratorMode(IntegratorMode mode);
+
+        /**
+         * Sets how runPhysics steps the world. Position based
+         * stepping ignores the resolver mode, the warm start and the
+         * integrator mode; it always predicts with symplectic Euler.
+         */
+        void setStepMode(StepMode mode);
+        StepMode getStepMode() const;
+
+        /**
+         * Sets the number of substeps each frame is split into by
+         * position based stepping. Eight by default.
+         */
+        void setSubsteps(unsigned substeps);
+        unsigned getSubsteps() const;
+
+        /**
+         * Turns on adaptive stepping: each frame is split into
+         * enough steps that no awake particle, at the speed it starts
+         * the frame with, moves more than the given fraction of its
+         * radius in one step, up to the given most steps. Position
+         * based stepping takes more substeps instead, never fewer
+         * than setSubsteps asks for. A fraction of zero, the default,
+         * turns it off.
+         */
+        void setAdaptiveStepping(float fraction, unsigned maxSteps = 16);
+        float getStepFraction() const;
+
+        /**
+         * Returns the number of steps (or substeps, with position
+         * based stepping) the last frame was split into.
+         */
+        unsigned getStepCount() const;
+
+        /**
+         * Returns the resolver position based stepping solves its
+         * contacts with, to set its passes and tolerance.
+         */
+        ParticleContactResolver& getPositionResolver();
+        IntegratorMode getIntegratorMode() const;
+
+        /**
+         * Returns the coloured resolver, to set its sweep count and
+         * tolerance.
+         */
+        ParticleColouredResolver& getColouredResolver();
+
+        /**
+         * Returns the Jacobi resolver, to set its sweep count,
+         * tolerance and relaxation.
+         */
+        ParticleJacobiResolver& getJacobiResolver();
+
+        /**
+         * Returns the island resolver, to set its iteration budget
+         * and read the islands found last frame.
+         */
+        ParticleIslands& getIslands();
+
+        /**
+         * Copies the particle positions, sizes and colours into a
+         * snapshot other threads can read while the simulation
+         * carries on. Call it from the simulating thread once the
+         * frame is finished. The stamp is passed on to the readers.
+         * Returns false if the readers held every free snapshot and
+         * this frame wasn't published.
+         */
+        bool publishSnapshot(double stamp = 0);
+
+        /**
+         * Returns the latest published snapshot, or null if there
+         * isn't one yet. It won't change until releaseSnapshot is
+         * called, so hand it back as soon as you are done. Safe to
+         * call from any thread, and never waits for the simulation.
+         */
+        const ParticleSnapshot* acquireSnapshot();
+
+        /**
+         * Hands back a snapshot from acquireSnapshot.
+         */
+        void releaseSnapshot(const ParticleSnapshot *snapshot);
+
+        /**
+         * Returns the snapshot buffer, for its publish counts.
+         */
+        const ParticleSnapshotBuffer& getSnapshotBuffer() const;
+
+        /**
+         * Returns the profiler, for the rolling summary of the phase
+         * times and counts and to trace frames. It stays empty unless
+         * the world was built with SPHERE_PROFILE.
+         */
+        ParticleProfiler& getProfiler();
+
 };
 
 
@@ -5,16 +5,17 @@
 #include "pcontacts.h"
 #include "pworld.h"
 #include "collision.h"
+#include "pstepper.h"
+#include "psegments.h"
+#include "prender.h"
 #include <stdio.h>
 #include <cassert>
 #include <random>
 #include <time.h>
 
 //Number of Particles, main system control of the amount of particles generated. 
-//Advised to keep to 200 or less unless mass controls in the constructor are changed
+//Particle collisions go through the world's broadphase grid so this can be raised well past a few hundred
 const int NoOfParticles = 100;
-//Gravity set to standard level
-const Vector2 Vector2::GRAVITY = Vector2(0,-9.81);
 
 /**
  * Platforms are two dimensional: lines on which the 
@@ -42,69 +43,10 @@ unsigned Platform::addContact(ParticleContact *contact, unsigned limit) const
     
 	//const static float restitution = 0.8f;
 	const static float restitution = 1.0f;
-	unsigned used = 0;
-        
-        // Check for penetration
-        Vector2 toParticle = particle->getPosition() - start;
-        Vector2 lineDirection = end - start;
-
-        float projected = toParticle * lineDirection;
-        float platformSqLength = lineDirection.squareMagnitude();
-		float squareRadius = particle->getRadius()*particle->getRadius();;
-		 
-       if (projected <= 0)
-        {
-		
-            // The blob is nearest to the start point
-            if (toParticle.squareMagnitude() < squareRadius)
-            {
-                // We have a collision
-                contact->contactNormal = toParticle.unit();
-                contact->restitution = restitution;
-                contact->particle[0] = particle;
-                contact->particle[1] = 0;
-                contact->penetration = particle->getRadius() - toParticle.magnitude();
-                used ++;
-                contact ++;
-            }
-            
-        }
-        else if (projected >= platformSqLength)
-        {
-            // The blob is nearest to the end point
-            toParticle = particle->getPosition() - end;
-            if (toParticle.squareMagnitude() < squareRadius)
-		    {
-                // We have a collision
-                contact->contactNormal = toParticle.unit();
-                contact->restitution = restitution;
-                contact->particle[0] = particle;
-                contact->particle[1] = 0;
-                contact->penetration = particle->getRadius() - toParticle.magnitude();
-                used ++;            
-                contact ++;
-            }
-        }
-        else
-        {
-            // the blob is nearest to the middle.
-            float distanceToPlatform = toParticle.squareMagnitude() - projected*projected / platformSqLength;
-            if (distanceToPlatform < squareRadius)
-            {
-                // We have a collision
-                Vector2 closestPoint = start + lineDirection*(projected/platformSqLength);
-
-                contact->contactNormal = (particle->getPosition()-closestPoint).unit();
-				contact->restitution = restitution;
-                contact->particle[0] = particle;
-                contact->particle[1] = 0;
-				contact->penetration = particle->getRadius() - sqrt(distanceToPlatform);
-	            used ++;
-                contact ++;
-            }
-        }
-
-    return used;
+	if (limit == 0) return 0;
+
+	//The closest point tests are shared with the level geometry generator
+	return segmentContact(start, end, particle, restitution, contact);
 }
 
 //Main class for application, overrides application class
@@ -114,6 +56,10 @@ class BlobDemo : public Application
     Particle *blob[NoOfParticles];
     Platform *platform;
     ParticleWorld world;
+	//Runs the physics on its own thread at a fixed timestep
+	ParticleStepper stepper;
+	//Draws all the particles in one go
+	ParticleRenderer renderer;
 
 public:
     /** Creates a new demo object. */
@@ -123,12 +69,18 @@ public:
     /** Returns the window title for the demo. */
     virtual const char* getTitle();
 
+    /** Sets up the graphics and starts the simulation thread. */
+    virtual void initGraphics();
+
     /** Display the particles. */
     virtual void display();
 
-    /** Update the particle positions. */
+    /** Asks for the next frame to be drawn. */
     virtual void update();
 
+    /** Advances the simulation by one fixed step, on the simulation thread. */
+    void step(float duration);
+
 	//Collision detection methods
 	//Checks to see if particles are close enough for a collision with the program window
 	//Bounces particles off the sides of the window
@@ -137,12 +89,12 @@ public:
 	bool out_of_box_test(Particle particle);
 	//Moves particles back in window if needed
 	void out_of_box_resolve(Particle &particle);
-	//Checks particles for validity for collision and then processes collisions by sending events to the collision class
-	void particle_collision_test(Particle &particle);
+	//Checks the broadphase pairs for validity for collision and then processes collisions by sending events to the collision class
+	void particle_collision_test();
 };
 
 // Method definitions
-BlobDemo::BlobDemo():world(2, 1)
+BlobDemo::BlobDemo():world(2, 1), stepper(&world, 0.01f)
 {
 	//Global control for the window width and height
 	width = 800; height = 800;
@@ -152,11 +104,17 @@ BlobDemo::BlobDemo():world(2, 1)
 	//Seeds random numbers at this point, needed to randomly geenrate particles
 	srand(time(NULL));
 
+	//Make room for all the particles up front, so they sit in as few slabs as possible
+	world.getParticleStore().reserve(NoOfParticles);
+
+	//Split a frame into shorter steps whenever something would move more than half its radius in one
+	world.setAdaptiveStepping(0.5f);
+
     // Create the blobs for the program, core constructor loop for blob details
 	for (int i = 0; i < NoOfParticles; i++)
 	{
-		//Create new particle
-		blob[i] = new Particle;
+		//Create new particle, the particle world owns it
+		blob[i] = world.createParticle();
 		//Initiate random position of a particle within the nRange bounds specified further above
 		//Changes to this area should be accomplished via changes to the nRange variable
 		float randomX = -nRange + static_cast <float> (rand()) / (static_cast <float> (RAND_MAX / (nRange - -nRange)));
@@ -193,8 +151,6 @@ BlobDemo::BlobDemo():world(2, 1)
 		//Collision status is set to false so that the particle defaults to not being in a collision state on program launch
 		//variable is used for preventing multiple collisions by one particle in a single frame
 		blob[i]->setCollisionStatus(false);
-		//Particle world is assigned each particle in turn, currently unused
-		world.getParticles().push_back(blob[i]);
 	}
 	   
     // Create and initialise the platform
@@ -203,16 +159,29 @@ BlobDemo::BlobDemo():world(2, 1)
 	//platform->start = Vector2 ( -50.0, 0.0 );
 	//platform->end   = Vector2 (  50.0, 0.0 );
 
-    // Make sure the platform knows which particle it should collide with.
-   // platform->particle = blob;
+    // The platform checks one particle at a time, the adapter runs it over every particle in the world.
+   // ParticleGeneratorAdapter<Platform> *platforms = new ParticleGeneratorAdapter<Platform>(platform, &world.getParticles());
 
-    //world.getContactGenerators().push_back(platform);
+    //world.getContactGenerators().push_back(platforms);
 }
 
 //Destructor for the demo
 BlobDemo::~BlobDemo()
 {
-    delete blob;
+	//Stop the simulation before anything it uses goes away
+	stepper.stop();
+    //The particles belong to the particle world, only the platform is ours
+    delete platform;
+}
+
+//Graphics setup, the simulation starts once there is a window to show it in
+void BlobDemo::initGraphics()
+{
+	Application::initGraphics();
+
+	//The physics steps at the timer interval, whatever the display manages
+	stepper.setStepDuration(timeinterval/1000);
+	stepper.start([this](float duration) { step(duration); });
 }
 
 //Main display function, used to render objects onto the screen
@@ -232,30 +201,32 @@ void BlobDemo::display()
 	glVertex2f(p1.x, p1.y);
 	glEnd();
 
-	//Begin main render loop for the particles
-	for (int i = 0; i < NoOfParticles; i++)
+	//Drawing reads the last frame the simulation thread published, never the particles it is busy moving
+	const ParticleSnapshot *snapshot = world.acquireSnapshot();
+	if (snapshot)
 	{
-		//Sets the colour of the particles depending on the random values assigned in the constructor
-		glColor3f(blob[i]->getRed(), blob[i]->getGreen(), blob[i]->getBlue());
-
-		//Code block that renders the particles to the position they are in
-		const Vector2 &p = blob[i]->getPosition();
-		glPushMatrix();
-		glTranslatef(p.x, p.y, 0);
-		glutSolidSphere(blob[i]->getRadius(), 12, 12);	//Radius, slices of the circle, stacks of the circle
-		glPopMatrix();
-		//Push/Pop matrix is used to place a new matrix onto the stack and then removes it, in effect allows the translation of objects
+		//Positions are blended between the last two physics steps so the motion stays smooth
+		//Every particle goes into one vertex array, then the whole lot is drawn with a single call
+		renderer.pack(*snapshot, stepper.getBlend(*snapshot));
+		//The packed copy is all the drawing needs, so the snapshot can go straight back
+		world.releaseSnapshot(snapshot);
+		renderer.draw();
 	}
 
 	//Presents the back buffer to the screen
 	glutSwapBuffers();
 }
 
-//Main program update step
+//Main program update step, the physics runs on its own thread so this only redraws
 void BlobDemo::update()
 {
-    // Recenter the axes
-	float duration = timeinterval/1000;
+	//Run main application update step (does little)
+    Application::update();
+}
+
+//Fixed physics step, called by the stepper on the simulation thread
+void BlobDemo::step(float duration)
+{
     // Run the simulation
     world.runPhysics(duration);
 
@@ -265,9 +236,11 @@ void BlobDemo::update()
 		//Checks to see if out of bounds or particle hits the edge of the box
 		box_collision_resolve(*blob[i]);
 		if (out_of_box_test(*blob[i])) out_of_box_resolve(*blob[i]);
-		//Checks to see if particles collide with each other, if so feeds into the main algorithm for collision detection
-		particle_collision_test(*blob[i]);
 	}
+	//The box passes can move particles, so find the pairs again from where they are now
+	world.broadphase();
+	//Checks to see if particles collide with each other, if so feeds into the main algorithm for collision detection
+	particle_collision_test();
 	//Reset loop for reseting the state of collisions to false at the end of the frame update
 	//This is needed because particles if they collide with each other have their status set to true so multiple collisions do not happen with the same particle in the same frame
 	for (int i = 0; i < NoOfParticles; i++)
@@ -275,9 +248,6 @@ void BlobDemo::update()
 		//Flicks bool to false
 		blob[i]->setCollisionStatus(false);
 	}
-
-	//Run main application update step (does little)
-    Application::update();
 }
 
 //Sets title for the program
@@ -355,30 +325,26 @@ void BlobDemo::out_of_box_resolve(Particle &particle)
 }
 
 //Main particle checking method, feeds into the collision.cpp files
-void BlobDemo::particle_collision_test(Particle &particle)
+//Only the pairs the world's broadphase found close enough to touch are checked
+void BlobDemo::particle_collision_test()
 {
-	//Main loop for the particle array
-	for (int i = 0; i < NoOfParticles; i++)
+	const ParticleWorld::Particles &particles = world.getParticles();
+	const ParticleWorld::ParticlePairs &pairs = world.getCandidatePairs();
+
+	//Main loop for the candidate pairs
+	for (unsigned i = 0; i < pairs.size(); i++)
 	{
-		//Check to see if particle being checked against is the same as the particle we're checking
-		//Also checks to see if a collision with each particle examined has happened this frame, if so then ignore said particle
-		if (particle.getID() == blob[i]->getID() || particle.getCollisionStatus() == true || blob[i]->getCollisionStatus() == true)
-		{
-			return;
-			//Do nothing if same particle
-			//or if particle has been collided this frame
-		}
-		else
-		{
-			//Setup new collision
-			Collision *collision = new Collision(&particle, blob[i]);
-
-			//Check for collision
-			//If collision is checked as true, then resolve the collision
-			if(collision->checkForCollision()) collision->resolveCollision();
-
-			//clean up
-			delete collision;
-		}
+		Particle *first = particles[pairs[i].index[0]];
+		Particle *second = particles[pairs[i].index[1]];
+
+		//Checks to see if a collision with either particle has happened this frame, if so then ignore the pair
+		if (first->getCollisionStatus() == true || second->getCollisionStatus() == true) continue;
+
+		//Setup the collision, it lives on the stack so nothing is allocated per pair
+		Collision collision(first, second);
+
+		//Check for collision
+		//If collision is checked as true, then resolve the collision
+		if(collision.checkForCollision()) collision.resolveCollision();
 	}
-}
\ No newline at end of file
+}
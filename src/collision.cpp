@@ -1,4 +1,5 @@
 #include "collision.h"
+#include "pworld.h"
 
 //Default constructor the collision, assigns two particles for a collision to the object's variables for future calculations
 Collision::Collision(Particle *p1, Particle *p2)
@@ -69,4 +70,70 @@ void Collision::resolveCollision()
 	//This is used to prevent multiple collisions occuring for one particle in a single frame of the application
 	particle1->setCollisionStatus(true);
 	particle2->setCollisionStatus(true);
-}
\ No newline at end of file
+}
+
+//Contact version of the collision check, used by the particle world's contact resolver
+//Unlike checkForCollision it leaves the particles where they are, the penetration is stored in the contact instead
+bool Collision::generateContact(ParticleContact *contact, float restitution) const
+{
+	const ParticleStore &store = *particle1->getStore();
+	return particleContact(store, particle1->getIndex(), particle2->getIndex(), restitution, contact) != 0;
+}
+
+unsigned particleContact(const ParticleStore &store, unsigned a, unsigned b, float restitution, ParticleContact *contact)
+{
+	float dx = store.positionX[a] - store.positionX[b];
+	float dy = store.positionY[a] - store.positionY[b];
+	float sumRadius = store.radius[a] + store.radius[b];
+	float squareDistance = dx * dx + dy * dy;
+	if (squareDistance > sumRadius * sumRadius) return 0;
+
+	//The contact normal points from the second particle towards the first
+	float distance = sqrt(squareDistance);
+	contact->contactNormal = distance > 0 ? Vector2(dx / distance, dy / distance) : Vector2(0, 1);
+	contact->restitution = restitution;
+	contact->particle[0] = store.getHandles()[a];
+	contact->particle[1] = store.getHandles()[b];
+	contact->penetration = sumRadius - distance;
+	return 1;
+}
+
+ParticleCollisionGenerator::ParticleCollisionGenerator(ParticleWorld *world, float restitution)
+{
+	ParticleCollisionGenerator::world = world;
+	ParticleCollisionGenerator::restitution = restitution;
+}
+
+unsigned ParticleCollisionGenerator::addContact(ParticleContact *contact, unsigned limit) const
+{
+	return addPairContacts(contact, limit, 0, (unsigned)world->getCandidatePairs().size());
+}
+
+unsigned ParticleCollisionGenerator::getPartitionCount() const
+{
+	unsigned pairs = (unsigned)world->getCandidatePairs().size();
+	return (pairs + PAIRS_PER_PARTITION - 1) / PAIRS_PER_PARTITION;
+}
+
+unsigned ParticleCollisionGenerator::addContactPartition(ParticleContact *contact, unsigned limit, unsigned partition) const
+{
+	unsigned pairs = (unsigned)world->getCandidatePairs().size();
+	unsigned begin = partition * PAIRS_PER_PARTITION;
+	unsigned end = begin + PAIRS_PER_PARTITION < pairs ? begin + PAIRS_PER_PARTITION : pairs;
+	if (begin >= end) return 0;
+	return addPairContacts(contact, limit, begin, end);
+}
+
+unsigned ParticleCollisionGenerator::addPairContacts(ParticleContact *contact, unsigned limit, unsigned begin, unsigned end) const
+{
+	const ParticleStore &store = world->getParticleStore();
+	const ParticleWorld::ParticlePairs &pairs = world->getCandidatePairs();
+
+	//The pair indices are store indices, so go straight to the arrays, there's nothing to allocate per pair
+	unsigned used = 0;
+	for (unsigned i = begin; i < end && used < limit; i++)
+	{
+		used += particleContact(store, pairs[i].index[0], pairs[i].index[1], restitution, contact + used);
+	}
+	return used;
+}
@@ -0,0 +1,399 @@
+#include <coreMath.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CORE_MATH_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang only emit SSE2/AVX2 instructions in functions that
+// ask for them; MSVC emits whatever the intrinsics use.
+#if defined(__GNUC__)
+#define CORE_MATH_SSE2 __attribute__((target("sse2")))
+#define CORE_MATH_AVX2 __attribute__((target("avx2")))
+#else
+#define CORE_MATH_SSE2
+#define CORE_MATH_AVX2
+#endif
+
+//Gravity set to standard level
+const Vector2 Vector2::GRAVITY = Vector2(0,-9.81f);
+const Vector2 Vector2::UP = Vector2(0,1);
+
+//Scalar versions, used on CPUs without SSE2 and for the leftover
+//elements at the end of the arrays in the wider versions
+static void scalarAxpy(float *y, const float *x, float scale, unsigned count)
+{
+    for (unsigned i = 0; i < count; i++) y[i] += x[i] * scale;
+}
+
+static void scalarAxpyWeighted(float *y, const float *x, const float *weight,
+    float scale, unsigned count)
+{
+    for (unsigned i = 0; i < count; i++) y[i] += x[i] * weight[i] * scale;
+}
+
+static void scalarDampingScale(float *x, float *y, const float *factor,
+    unsigned count)
+{
+    for (unsigned i = 0; i < count; i++)
+    {
+        x[i] *= factor[i];
+        y[i] *= factor[i];
+    }
+}
+
+static void scalarLength(float *length, const float *x, const float *y,
+    unsigned count)
+{
+    for (unsigned i = 0; i < count; i++)
+    {
+        length[i] = sqrtf(x[i]*x[i] + y[i]*y[i]);
+    }
+}
+
+static void scalarNormalise(float *x, float *y, unsigned count)
+{
+    for (unsigned i = 0; i < count; i++)
+    {
+        float l = sqrtf(x[i]*x[i] + y[i]*y[i]);
+        if (l > 0)
+        {
+            x[i] *= ((float)1)/l;
+            y[i] *= ((float)1)/l;
+        }
+    }
+}
+
+static void scalarDot(float *result, const float *ax, const float *ay,
+    const float *bx, const float *by, unsigned count)
+{
+    for (unsigned i = 0; i < count; i++)
+    {
+        result[i] = ax[i]*bx[i] + ay[i]*by[i];
+    }
+}
+
+#ifdef CORE_MATH_X86
+
+//SSE2 versions, four elements at a time
+CORE_MATH_SSE2 static void sse2Axpy(float *y, const float *x, float scale,
+    unsigned count)
+{
+    unsigned i = 0;
+    __m128 s = _mm_set1_ps(scale);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 r = _mm_add_ps(_mm_loadu_ps(y + i),
+            _mm_mul_ps(_mm_loadu_ps(x + i), s));
+        _mm_storeu_ps(y + i, r);
+    }
+    scalarAxpy(y + i, x + i, scale, count - i);
+}
+
+CORE_MATH_SSE2 static void sse2AxpyWeighted(float *y, const float *x,
+    const float *weight, float scale, unsigned count)
+{
+    unsigned i = 0;
+    __m128 s = _mm_set1_ps(scale);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 w = _mm_mul_ps(_mm_loadu_ps(weight + i), s);
+        __m128 r = _mm_add_ps(_mm_loadu_ps(y + i),
+            _mm_mul_ps(_mm_loadu_ps(x + i), w));
+        _mm_storeu_ps(y + i, r);
+    }
+    scalarAxpyWeighted(y + i, x + i, weight + i, scale, count - i);
+}
+
+CORE_MATH_SSE2 static void sse2DampingScale(float *x, float *y,
+    const float *factor, unsigned count)
+{
+    unsigned i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 f = _mm_loadu_ps(factor + i);
+        _mm_storeu_ps(x + i, _mm_mul_ps(_mm_loadu_ps(x + i), f));
+        _mm_storeu_ps(y + i, _mm_mul_ps(_mm_loadu_ps(y + i), f));
+    }
+    scalarDampingScale(x + i, y + i, factor + i, count - i);
+}
+
+CORE_MATH_SSE2 static void sse2Length(float *length, const float *x,
+    const float *y, unsigned count)
+{
+    unsigned i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 vx = _mm_loadu_ps(x + i);
+        __m128 vy = _mm_loadu_ps(y + i);
+        __m128 sq = _mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy));
+        _mm_storeu_ps(length + i, _mm_sqrt_ps(sq));
+    }
+    scalarLength(length + i, x + i, y + i, count - i);
+}
+
+CORE_MATH_SSE2 static void sse2Normalise(float *x, float *y, unsigned count)
+{
+    unsigned i = 0;
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.0f);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 vx = _mm_loadu_ps(x + i);
+        __m128 vy = _mm_loadu_ps(y + i);
+        __m128 l = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)));
+
+        // Zero length vectors are left alone: pick a scale of one
+        __m128 nonZero = _mm_cmpgt_ps(l, zero);
+        __m128 inverse = _mm_div_ps(one, l);
+        __m128 scale = _mm_or_ps(_mm_and_ps(nonZero, inverse),
+            _mm_andnot_ps(nonZero, one));
+
+        _mm_storeu_ps(x + i, _mm_mul_ps(vx, scale));
+        _mm_storeu_ps(y + i, _mm_mul_ps(vy, scale));
+    }
+    scalarNormalise(x + i, y + i, count - i);
+}
+
+CORE_MATH_SSE2 static void sse2Dot(float *result, const float *ax,
+    const float *ay, const float *bx, const float *by, unsigned count)
+{
+    unsigned i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 r = _mm_add_ps(
+            _mm_mul_ps(_mm_loadu_ps(ax + i), _mm_loadu_ps(bx + i)),
+            _mm_mul_ps(_mm_loadu_ps(ay + i), _mm_loadu_ps(by + i)));
+        _mm_storeu_ps(result + i, r);
+    }
+    scalarDot(result + i, ax + i, ay + i, bx + i, by + i, count - i);
+}
+
+//AVX2 versions, eight elements at a time
+CORE_MATH_AVX2 static void avx2Axpy(float *y, const float *x, float scale,
+    unsigned count)
+{
+    unsigned i = 0;
+    __m256 s = _mm256_set1_ps(scale);
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 r = _mm256_add_ps(_mm256_loadu_ps(y + i),
+            _mm256_mul_ps(_mm256_loadu_ps(x + i), s));
+        _mm256_storeu_ps(y + i, r);
+    }
+    scalarAxpy(y + i, x + i, scale, count - i);
+}
+
+CORE_MATH_AVX2 static void avx2AxpyWeighted(float *y, const float *x,
+    const float *weight, float scale, unsigned count)
+{
+    unsigned i = 0;
+    __m256 s = _mm256_set1_ps(scale);
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 w = _mm256_mul_ps(_mm256_loadu_ps(weight + i), s);
+        __m256 r = _mm256_add_ps(_mm256_loadu_ps(y + i),
+            _mm256_mul_ps(_mm256_loadu_ps(x + i), w));
+        _mm256_storeu_ps(y + i, r);
+    }
+    scalarAxpyWeighted(y + i, x + i, weight + i, scale, count - i);
+}
+
+CORE_MATH_AVX2 static void avx2DampingScale(float *x, float *y,
+    const float *factor, unsigned count)
+{
+    unsigned i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 f = _mm256_loadu_ps(factor + i);
+        _mm256_storeu_ps(x + i, _mm256_mul_ps(_mm256_loadu_ps(x + i), f));
+        _mm256_storeu_ps(y + i, _mm256_mul_ps(_mm256_loadu_ps(y + i), f));
+    }
+    scalarDampingScale(x + i, y + i, factor + i, count - i);
+}
+
+CORE_MATH_AVX2 static void avx2Length(float *length, const float *x,
+    const float *y, unsigned count)
+{
+    unsigned i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 vx = _mm256_loadu_ps(x + i);
+        __m256 vy = _mm256_loadu_ps(y + i);
+        __m256 sq = _mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy));
+        _mm256_storeu_ps(length + i, _mm256_sqrt_ps(sq));
+    }
+    scalarLength(length + i, x + i, y + i, count - i);
+}
+
+CORE_MATH_AVX2 static void avx2Normalise(float *x, float *y, unsigned count)
+{
+    unsigned i = 0;
+    __m256 zero = _mm256_setzero_ps();
+    __m256 one = _mm256_set1_ps(1.0f);
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 vx = _mm256_loadu_ps(x + i);
+        __m256 vy = _mm256_loadu_ps(y + i);
+        __m256 l = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(vx, vx),
+            _mm256_mul_ps(vy, vy)));
+
+        // Zero length vectors are left alone: pick a scale of one
+        __m256 nonZero = _mm256_cmp_ps(l, zero, _CMP_GT_OQ);
+        __m256 scale = _mm256_blendv_ps(one, _mm256_div_ps(one, l), nonZero);
+
+        _mm256_storeu_ps(x + i, _mm256_mul_ps(vx, scale));
+        _mm256_storeu_ps(y + i, _mm256_mul_ps(vy, scale));
+    }
+    scalarNormalise(x + i, y + i, count - i);
+}
+
+CORE_MATH_AVX2 static void avx2Dot(float *result, const float *ax,
+    const float *ay, const float *bx, const float *by, unsigned count)
+{
+    unsigned i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 r = _mm256_add_ps(
+            _mm256_mul_ps(_mm256_loadu_ps(ax + i), _mm256_loadu_ps(bx + i)),
+            _mm256_mul_ps(_mm256_loadu_ps(ay + i), _mm256_loadu_ps(by + i)));
+        _mm256_storeu_ps(result + i, r);
+    }
+    scalarDot(result + i, ax + i, ay + i, bx + i, by + i, count - i);
+}
+
+//Checks what the CPU (and the operating system, which has to save the
+//wider registers) supports
+static bool cpuHasSse2()
+{
+#if defined(_M_X64) || defined(__x86_64__)
+    return true;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#else
+    return __builtin_cpu_supports("sse2") != 0;
+#endif
+}
+
+static bool cpuHasAvx2()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+
+    // The OS has to have enabled the AVX state with XSAVE
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx) return false;
+    if ((_xgetbv(0) & 6) != 6) return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+#endif // CORE_MATH_X86
+
+//Dispatch table, filled in with the widest implementation available
+struct BatchKernels
+{
+    void (*axpy)(float*, const float*, float, unsigned);
+    void (*axpyWeighted)(float*, const float*, const float*, float, unsigned);
+    void (*dampingScale)(float*, float*, const float*, unsigned);
+    void (*length)(float*, const float*, const float*, unsigned);
+    void (*normalise)(float*, float*, unsigned);
+    void (*dot)(float*, const float*, const float*, const float*, const float*, unsigned);
+    const char *name;
+};
+
+static BatchKernels selectKernels()
+{
+    BatchKernels k;
+    k.axpy = scalarAxpy;
+    k.axpyWeighted = scalarAxpyWeighted;
+    k.dampingScale = scalarDampingScale;
+    k.length = scalarLength;
+    k.normalise = scalarNormalise;
+    k.dot = scalarDot;
+    k.name = "scalar";
+
+#ifdef CORE_MATH_X86
+    if (cpuHasAvx2())
+    {
+        k.axpy = avx2Axpy;
+        k.axpyWeighted = avx2AxpyWeighted;
+        k.dampingScale = avx2DampingScale;
+        k.length = avx2Length;
+        k.normalise = avx2Normalise;
+        k.dot = avx2Dot;
+        k.name = "avx2";
+    }
+    else if (cpuHasSse2())
+    {
+        k.axpy = sse2Axpy;
+        k.axpyWeighted = sse2AxpyWeighted;
+        k.dampingScale = sse2DampingScale;
+        k.length = sse2Length;
+        k.normalise = sse2Normalise;
+        k.dot = sse2Dot;
+        k.name = "sse2";
+    }
+#endif
+
+    return k;
+}
+
+static const BatchKernels &kernels()
+{
+    // Picked once at start up, before any threads exist
+    static const BatchKernels selected = selectKernels();
+    return selected;
+}
+
+static const BatchKernels &startupKernels = kernels();
+
+void batchAxpy(float *y, const float *x, float scale, unsigned count)
+{
+    kernels().axpy(y, x, scale, count);
+}
+
+void batchAxpyWeighted(float *y, const float *x, const float *weight,
+    float scale, unsigned count)
+{
+    kernels().axpyWeighted(y, x, weight, scale, count);
+}
+
+void batchDampingScale(float *x, float *y, const float *factor, unsigned count)
+{
+    kernels().dampingScale(x, y, factor, count);
+}
+
+void batchLength(float *length, const float *x, const float *y, unsigned count)
+{
+    kernels().length(length, x, y, count);
+}
+
+void batchNormalise(float *x, float *y, unsigned count)
+{
+    kernels().normalise(x, y, count);
+}
+
+void batchDot(float *result, const float *ax, const float *ay,
+    const float *bx, const float *by, unsigned count)
+{
+    kernels().dot(result, ax, ay, bx, by, count);
+}
+
+const char* batchInstructionSet()
+{
+    return kernels().name;
+}
@@ -19,7 +19,7 @@ void createWindow(const char* title, int h, int w)
     glutCreateWindow(title);
 }
 
-//Used to regulate the speed of the program
+//Used to regulate the redraw rate, the physics runs on its own thread at a fixed step
 void TimerFunc(int value)
 {
     app->update();
@@ -0,0 +1,92 @@
+#include <parena.h>
+
+ParticleContactArena::ParticleContactArena(unsigned capacity)
+:
+contacts(capacity ? capacity : 1),
+used(0),
+peak(0),
+droppedLastFrame(0),
+droppedTotal(0),
+growCount(0)
+{
+}
+
+void ParticleContactArena::reset()
+{
+    used = 0;
+    droppedLastFrame = 0;
+}
+
+void ParticleContactArena::reserve(unsigned count)
+{
+    unsigned capacity = (unsigned)contacts.size();
+    if (count <= capacity) return;
+
+    // Grow geometrically so a rising load settles after a few frames
+    unsigned grown = capacity * 2;
+    if (grown < count) grown = count;
+    contacts.resize(grown);
+    growCount++;
+}
+
+ParticleContact* ParticleContactArena::data()
+{
+    return &contacts[0];
+}
+
+ParticleContact* ParticleContactArena::at(unsigned index)
+{
+    return &contacts[0] + index;
+}
+
+const ParticleContact* ParticleContactArena::at(unsigned index) const
+{
+    return &contacts[0] + index;
+}
+
+unsigned ParticleContactArena::getCapacity() const
+{
+    return (unsigned)contacts.size();
+}
+
+void ParticleContactArena::setUsed(unsigned count)
+{
+    used = count;
+    if (used > peak) peak = used;
+}
+
+unsigned ParticleContactArena::getUsed() const
+{
+    return used;
+}
+
+unsigned ParticleContactArena::limit(unsigned count)
+{
+    if (used > count)
+    {
+        droppedLastFrame += used - count;
+        droppedTotal += used - count;
+        used = count;
+    }
+    return used;
+}
+
+unsigned ParticleContactArena::getPeak() const
+{
+    return peak;
+}
+
+unsigned ParticleContactArena::getDroppedLastFrame() const
+{
+    return droppedLastFrame;
+}
+
+unsigned long long ParticleContactArena::getDroppedTotal() const
+{
+    return droppedTotal;
+}
+
+unsigned ParticleContactArena::getGrowCount() const
+{
+    return growCount;
+}
@@ -1,30 +1,55 @@
 #include "particle.h"
+#include "pintegrator.h"
 #include <math.h>
 #include <assert.h>
 #include <float.h>
 
 //Main force application section
 //Deals with forces applied to particles 
+Particle::Particle(ParticleStore *store, unsigned index)
+:
+store(store),
+index(index)
+{
+}
+
+ParticleStore* Particle::getStore() const { return store; }
+unsigned Particle::getIndex() const { return index; }
+
 void Particle::integrate(float duration)
 {
 	// We don't integrate things with zero mass.
-   if (inverseMass <= 0.0f) return;
+	float inverseMass = store->inverseMass[index];
+	if (inverseMass <= 0.0f) return;
 
 	assert(duration > 0.0);
-	position.addScaledVector(velocity, duration);
-
-	// Work out the acceleration from the force
-    Vector2 resultingAcc = acceleration;
-    resultingAcc.addScaledVector(forceAccum, inverseMass);
-
-	// Update linear velocity from the acceleration.
-    velocity.addScaledVector(resultingAcc, duration);
 
-	// Impose drag.
-	velocity *= pow(damping, duration);
+	// Run the world's default policy over just this particle, skipping
+	// the pow when there is no drag
+	float damping = store->damping[index];
+	float one = 1.0f;
+	float drag = damping == 1.0f ? 1.0f : (float)pow(damping, duration);
+
+	IntegrationSpan span;
+	span.positionX = &store->positionX[index];
+	span.positionY = &store->positionY[index];
+	span.velocityX = &store->velocityX[index];
+	span.velocityY = &store->velocityY[index];
+	span.accelerationX = &store->accelerationX[index];
+	span.accelerationY = &store->accelerationY[index];
+	span.forceAccumX = &store->forceAccumX[index];
+	span.forceAccumY = &store->forceAccumY[index];
+	span.mask = &one;
+	span.forceScale = &inverseMass;
+	span.dragFactor = &drag;
+	span.count = 1;
+
+	IntegrationStep step(duration);
+	if (damping == 1.0f) ParticleEulerIntegrator::integrate<false>(span, step);
+	else ParticleEulerIntegrator::integrate<true>(span, step);
 
 	// Clear the forces.
-    clearAccumulator();
+	clearAccumulator();
 }
 
 //Getters and Setters for the Particle class
@@ -33,11 +58,12 @@ void Particle::integrate(float duration)
 void Particle::setMass(const float mass)
 {
     assert(mass != 0);
-    Particle::inverseMass = ((float)1.0)/mass;
+    store->inverseMass[index] = ((float)1.0)/mass;
 }
 
 float Particle::getMass() const
 {
+    float inverseMass = store->inverseMass[index];
     if (inverseMass == 0) {
         return DBL_MAX;
     } else {
@@ -45,45 +71,70 @@ float Particle::getMass() const
     }
 }
 
-void Particle::setInverseMass(const float inverseMass) { Particle::inverseMass = inverseMass; }
-float Particle::getInverseMass() const { return inverseMass; }
-bool Particle::hasFiniteMass() const { return inverseMass >= 0.0f; }
+void Particle::setInverseMass(const float inverseMass) { store->inverseMass[index] = inverseMass; }
+float Particle::getInverseMass() const { return store->inverseMass[index]; }
+bool Particle::hasFiniteMass() const { return store->inverseMass[index] >= 0.0f; }
 
-void Particle::setDamping(const float damping) { Particle::damping = damping; }
-float Particle::getDamping() const { return damping; }
+void Particle::setDamping(const float damping) { store->damping[index] = damping; }
+float Particle::getDamping() const { return store->damping[index]; }
 
-void Particle::setPosition(const float x, const float y) { position.x = x; position.y = y; }
-void Particle::setPosition(const Vector2 &position) { Particle::position = position; }
+void Particle::setPosition(const float x, const float y) { store->positionX[index] = x; store->positionY[index] = y; }
+void Particle::setPosition(const Vector2 &position) { setPosition(position.x, position.y); }
 
-Vector2 Particle::getPosition() const { return position; }
-void Particle::getPosition(Vector2 *position) const { *position = Particle::position; }
+Vector2 Particle::getPosition() const { return Vector2(store->positionX[index], store->positionY[index]); }
+void Particle::getPosition(Vector2 *position) const { *position = getPosition(); }
 
-void Particle::setRadius(const float r) { radius = r; }
-float Particle::getRadius() const { return radius; }
+void Particle::setRadius(const float r) { store->radius[index] = r; }
+float Particle::getRadius() const { return store->radius[index]; }
 
-void Particle::setVelocity(const float x, const float y) { velocity.x = x; velocity.y = y; }
-void Particle::setVelocity(const Vector2 &velocity) { Particle::velocity = velocity; }
-Vector2 Particle::getVelocity() const { return velocity; }
-void Particle::getVelocity(Vector2 *velocity) const { *velocity = Particle::velocity; }
+void Particle::setVelocity(const float x, const float y)
+{
+	store->velocityX[index] = x;
+	store->velocityY[index] = y;
+	//A new velocity starts a new average, so a thrown particle counts as moving straight away
+	store->averageVelocityX[index] = x;
+	store->averageVelocityY[index] = y;
+	//Only a sleeper is woken here. An awake particle keeps its sleep timer, which the
+	//world resets itself once the new average is fast enough
+	if (!store->awake[index] && (x != 0 || y != 0)) setAwake();
+}
+void Particle::setVelocity(const Vector2 &velocity) { setVelocity(velocity.x, velocity.y); }
+Vector2 Particle::getVelocity() const { return Vector2(store->velocityX[index], store->velocityY[index]); }
+void Particle::getVelocity(Vector2 *velocity) const { *velocity = getVelocity(); }
+
+void Particle::setAcceleration(const Vector2 &acceleration) { setAcceleration(acceleration.x, acceleration.y); }
+void Particle::setAcceleration(const float x, const float y) { store->accelerationX[index] = x; store->accelerationY[index] = y; }
+Vector2 Particle::getAcceleration() const { return Vector2(store->accelerationX[index], store->accelerationY[index]); }
 
-void Particle::setAcceleration(const Vector2 &acceleration) { Particle::acceleration = acceleration; }
-void Particle::setAcceleration(const float x, const float y) { acceleration.x = x; acceleration.y = y; }
-Vector2 Particle::getAcceleration() const { return acceleration; }
+void Particle::clearAccumulator(){ store->forceAccumX[index] = 0; store->forceAccumY[index] = 0; }
 
-void Particle::clearAccumulator(){ forceAccum.clear(); }
+void Particle::addForce(const Vector2 &force) { store->forceAccumX[index] += force.x; store->forceAccumY[index] += force.y; setAwake(); }
 
-void Particle::addForce(const Vector2 &force) { forceAccum += force; }
+bool Particle::isAwake() const { return store->awake[index] != 0; }
+
+void Particle::setAwake(const bool awake)
+{
+	store->awake[index] = awake;
+	store->sleepTime[index] = 0;
+	if (!awake)
+	{
+		store->velocityX[index] = 0;
+		store->velocityY[index] = 0;
+		store->averageVelocityX[index] = 0;
+		store->averageVelocityY[index] = 0;
+	}
+}
 
-int Particle::getID() {	return ID; }
-void Particle::setID(int i) { ID = i; }
+int Particle::getID() {	return store->ID[index]; }
+void Particle::setID(int i) { store->ID[index] = i; }
 
-bool Particle::getCollisionStatus() { return collisionStatus; }
-void Particle::setCollisionStatus(bool c) { collisionStatus = c; }
+bool Particle::getCollisionStatus() { return store->collisionStatus[index] != 0; }
+void Particle::setCollisionStatus(bool c) { store->collisionStatus[index] = c; }
 
-float Particle::getRed() { return red; }
-float Particle::getGreen() { return green; }
-float Particle::getBlue() { return blue; }
+float Particle::getRed() { return store->red[index]; }
+float Particle::getGreen() { return store->green[index]; }
+float Particle::getBlue() { return store->blue[index]; }
 
-void Particle::setRed(float r) { red = r; }
-void Particle::setGreen(float g) { green = g; }
-void Particle::setBlue(float b) { blue = b; }
\ No newline at end of file
+void Particle::setRed(float r) { store->red[index] = r; }
+void Particle::setGreen(float g) { store->green[index] = g; }
+void Particle::setBlue(float b) { store->blue[index] = b; }
\ No newline at end of file
@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <pcache.h>
+
+bool ParticleContactCache::Entry::operator<(const Entry &other) const
+{
+    if (first != other.first) return first < other.first;
+    if (second != other.second) return second < other.second;
+    if (ordinal != other.ordinal) return ordinal < other.ordinal;
+    return contact < other.contact;
+}
+
+// Compares just the keys, leaving out the contact index
+static bool sameKey(unsigned first, unsigned second, unsigned ordinal,
+                    unsigned otherFirst, unsigned otherSecond, unsigned otherOrdinal)
+{
+    return first == otherFirst && second == otherSecond && ordinal == otherOrdinal;
+}
+
+ParticleContactCache::ParticleContactCache()
+:
+warmStartFactor(0.8f),
+normalTolerance(0.95f),
+matched(0)
+{
+}
+
+void ParticleContactCache::setWarmStartFactor(float factor)
+{
+    warmStartFactor = factor;
+}
+
+void ParticleContactCache::setNormalTolerance(float tolerance)
+{
+    normalTolerance = tolerance;
+}
+
+// Applies an impulse along the contact normal, as ParticleContact does
+static void applyImpulse(ParticleStore &store, const ParticleContact &contact, float impulse)
+{
+    unsigned a = contact.particle[0]->getIndex();
+    Vector2 impulsePerIMass = contact.contactNormal * impulse;
+    store.velocityX[a] += impulsePerIMass.x * store.inverseMass[a];
+    store.velocityY[a] += impulsePerIMass.y * store.inverseMass[a];
+    if (contact.particle[1])
+    {
+        unsigned b = contact.particle[1]->getIndex();
+        store.velocityX[b] -= impulsePerIMass.x * store.inverseMass[b];
+        store.velocityY[b] -= impulsePerIMass.y * store.inverseMass[b];
+    }
+}
+
+void ParticleContactCache::warmStart(ParticleContact *contactArray,
+                                     unsigned numContacts)
+{
+    matched = 0;
+    current.resize(numContacts);
+    if (numContacts == 0) return;
+
+    ParticleStore &store = *contactArray[0].particle[0]->getStore();
+
+    // Key each contact, lower ID first, with the normal turned to
+    // match. The ordinal is filled in once they're sorted.
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        const ParticleContact &contact = contactArray[i];
+        Entry &entry = current[i];
+        unsigned a = (unsigned)store.ID[contact.particle[0]->getIndex()];
+        unsigned b = contact.particle[1] ?
+            (unsigned)store.ID[contact.particle[1]->getIndex()] : (unsigned)SCENERY;
+        entry.first = a < b ? a : b;
+        entry.second = a < b ? b : a;
+        entry.ordinal = 0;
+        entry.contact = i;
+        entry.normal = a < b ? contact.contactNormal : contact.contactNormal * -1;
+        entry.impulse = 0;
+        entry.target = 0;
+    }
+
+    // Sorting by contact index within a pair keeps the generation
+    // order, so the nth contact of a pair is numbered n
+    std::sort(current.begin(), current.end());
+    for (unsigned i = 1; i < numContacts; i++)
+    {
+        if (current[i].first == current[i - 1].first &&
+            current[i].second == current[i - 1].second)
+        {
+            current[i].ordinal = current[i - 1].ordinal + 1;
+        }
+    }
+
+    // Merge against last frame's list, working out each match's
+    // impulse and the separating velocity it should end up with:
+    // the bounce off its closing velocity before any warm start, or
+    // zero if it isn't closing
+    unsigned p = 0;
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        Entry &entry = current[i];
+
+        // Setting the contact index to zero makes the key sort
+        // before any entry with the same particles and ordinal
+        Entry key = entry;
+        key.contact = 0;
+        while (p < previous.size() && previous[p] < key) p++;
+        if (p == previous.size()) continue;
+
+        const Entry &old = previous[p];
+        if (!sameKey(old.first, old.second, old.ordinal,
+            key.first, key.second, key.ordinal)) continue;
+        if (old.normal * entry.normal < normalTolerance) continue;
+
+        const ParticleContact &contact = contactArray[entry.contact];
+        float separatingVelocity = contact.calculateSeparatingVelocity();
+        entry.impulse = old.impulse * warmStartFactor;
+        entry.target = separatingVelocity < 0 ? -separatingVelocity * contact.restitution : 0;
+    }
+
+    // Apply every remembered impulse
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        if (current[i].impulse > 0) applyImpulse(store, contactArray[current[i].contact], current[i].impulse);
+    }
+
+    // Then take back what overshoots, so last frame's impact doesn't
+    // launch a contact that is already bouncing apart. A resting
+    // contact's impulse is about right, and stays.
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        Entry &entry = current[i];
+        ParticleContact &contact = contactArray[entry.contact];
+        contact.accumulatedImpulse = 0;
+        if (entry.impulse <= 0) continue;
+
+        float totalInverseMass = store.inverseMass[contact.particle[0]->getIndex()];
+        if (contact.particle[1]) totalInverseMass += store.inverseMass[contact.particle[1]->getIndex()];
+
+        float excess = contact.calculateSeparatingVelocity() - entry.target;
+        if (excess > 0 && totalInverseMass > 0)
+        {
+            float removed = excess / totalInverseMass;
+            if (removed > entry.impulse) removed = entry.impulse;
+            applyImpulse(store, contact, -removed);
+            entry.impulse -= removed;
+        }
+
+        contact.accumulatedImpulse = entry.impulse;
+        if (entry.impulse > 0) matched++;
+    }
+}
+
+void ParticleContactCache::update(ParticleContact *contactArray,
+                                  unsigned numContacts)
+{
+    // The list is already in key order from warmStart
+    if (current.size() != numContacts) current.clear();
+    for (unsigned i = 0; i < current.size(); i++)
+    {
+        current[i].impulse = contactArray[current[i].contact].accumulatedImpulse;
+    }
+    previous.swap(current);
+}
+
+void ParticleContactCache::clear()
+{
+    previous.clear();
+    current.clear();
+    matched = 0;
+}
+
+unsigned ParticleContactCache::getMatchedCount() const
+{
+    return matched;
+}
+
+unsigned ParticleContactCache::getSize() const
+{
+    return (unsigned)previous.size();
+}
@@ -0,0 +1,139 @@
+#include <pcolour.h>
+
+ParticleColouredResolver::ParticleColouredResolver(WorkerPool *workers,
+                                                   unsigned iterations)
+:
+iterations(iterations),
+iterationsUsed(0),
+velocityTolerance(0.01f),
+workers(workers),
+colourCount(0)
+{
+}
+
+void ParticleColouredResolver::setIterations(unsigned iterations)
+{
+    ParticleColouredResolver::iterations = iterations;
+}
+
+void ParticleColouredResolver::setVelocityTolerance(float tolerance)
+{
+    velocityTolerance = tolerance;
+}
+
+unsigned ParticleColouredResolver::getIterationsUsed() const
+{
+    return iterationsUsed;
+}
+
+unsigned ParticleColouredResolver::getColourCount() const
+{
+    return colourCount;
+}
+
+void ParticleColouredResolver::colourContacts(ParticleContact *contactArray,
+                                              unsigned numContacts)
+{
+    particleColours.assign(contactArray[0].particle[0]->getStore()->size(), 0);
+    contactColour.resize(numContacts);
+    colourStart.assign(MAX_COLOURS + 2, 0);
+
+    // Greedy colouring: give each contact the lowest colour neither
+    // of its particles has used yet.
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        const ParticleContact &contact = contactArray[i];
+        unsigned a = contact.particle[0]->getIndex();
+        unsigned long long used = particleColours[a];
+        if (contact.particle[1]) used |= particleColours[contact.particle[1]->getIndex()];
+
+        unsigned colour = 0;
+        while (colour < MAX_COLOURS && (used & (1ULL << colour))) colour++;
+
+        if (colour < MAX_COLOURS)
+        {
+            particleColours[a] |= 1ULL << colour;
+            if (contact.particle[1])
+            {
+                particleColours[contact.particle[1]->getIndex()] |= 1ULL << colour;
+            }
+        }
+        contactColour[i] = colour;
+        colourStart[colour + 1]++;
+    }
+
+    // Counting sort into batches
+    for (unsigned c = 0; c <= MAX_COLOURS; c++)
+    {
+        colourStart[c + 1] += colourStart[c];
+    }
+    colourOrder.resize(numContacts);
+    colourCursor.assign(colourStart.begin(), colourStart.end() - 1);
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        colourOrder[colourCursor[contactColour[i]]++] = i;
+    }
+
+    // Count the colours actually used
+    colourCount = 0;
+    for (unsigned c = 0; c <= MAX_COLOURS; c++)
+    {
+        if (colourStart[c + 1] > colourStart[c]) colourCount = c + 1;
+    }
+}
+
+void ParticleColouredResolver::resolveContacts(ParticleContact *contactArray,
+                                               unsigned numContacts,
+                                               float duration)
+{
+    iterationsUsed = 0;
+    if (numContacts == 0) return;
+
+    colourContacts(contactArray, numContacts);
+    threadWorst.resize(workers->getThreadSlots());
+
+    auto resolveBatch =
+        [this, contactArray, duration](unsigned begin, unsigned end, unsigned thread)
+    {
+        float worst = threadWorst[thread].closingVelocity;
+        for (unsigned i = begin; i < end; i++)
+        {
+            ParticleContact &contact = contactArray[colourOrder[i]];
+            float sepVel = contact.calculateSeparatingVelocity();
+            if (sepVel < 0)
+            {
+                if (-sepVel > worst) worst = -sepVel;
+                contact.resolveVelocity(duration);
+            }
+        }
+        threadWorst[thread].closingVelocity = worst;
+    };
+
+    while (iterationsUsed < iterations)
+    {
+        for (unsigned t = 0; t < threadWorst.size(); t++)
+        {
+            threadWorst[t].closingVelocity = 0;
+        }
+
+        for (unsigned c = 0; c < colourCount; c++)
+        {
+            unsigned begin = colourStart[c];
+            unsigned end = colourStart[c + 1];
+
+            // The overflow batch may share particles, so it stays on
+            // this thread
+            if (c == MAX_COLOURS) resolveBatch(begin, end, 0);
+            else workers->parallelForIndexed(begin, end, 0, resolveBatch);
+        }
+        iterationsUsed++;
+
+        // Stop once nothing was closing faster than the tolerance
+        float worst = 0;
+        for (unsigned t = 0; t < threadWorst.size(); t++)
+        {
+            if (threadWorst[t].closingVelocity > worst) worst = threadWorst[t].closingVelocity;
+        }
+        if (worst <= velocityTolerance) break;
+    }
+}
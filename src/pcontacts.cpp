@@ -11,9 +11,18 @@ void ParticleContact::resolve(float duration)
 
 float ParticleContact::calculateSeparatingVelocity() const
 {
-    Vector2 relativeVelocity = particle[0]->getVelocity();
-    if (particle[1]) relativeVelocity -= particle[1]->getVelocity();
-    return relativeVelocity * contactNormal;
+    // Read the velocities straight from the store's arrays
+    const ParticleStore &store = *particle[0]->getStore();
+    unsigned a = particle[0]->getIndex();
+    float relativeX = store.velocityX[a];
+    float relativeY = store.velocityY[a];
+    if (particle[1])
+    {
+        unsigned b = particle[1]->getIndex();
+        relativeX -= store.velocityX[b];
+        relativeY -= store.velocityY[b];
+    }
+    return relativeX * contactNormal.x + relativeY * contactNormal.y;
 }
 
 void ParticleContact::resolveVelocity(float duration)
@@ -36,35 +45,99 @@ void ParticleContact::resolveVelocity(float duration)
     // We apply the change in velocity to each object in proportion to
     // their inverse mass (i.e. those with lower inverse mass [higher
     // actual mass] get less change in velocity)..
-    float totalInverseMass = particle[0]->getInverseMass();
-    if (particle[1]) totalInverseMass += particle[1]->getInverseMass();
+    ParticleStore &store = *particle[0]->getStore();
+    unsigned a = particle[0]->getIndex();
+    unsigned b = particle[1] ? particle[1]->getIndex() : 0;
+    float totalInverseMass = store.inverseMass[a];
+    if (particle[1]) totalInverseMass += store.inverseMass[b];
 
     // If all particles have infinite mass, then impulses have no effect
     if (totalInverseMass <= 0) return;
 
     // Calculate the impulse to apply
     float impulse = deltaVelocity / totalInverseMass;
+    accumulatedImpulse += impulse;
 
     // Find the amount of impulse per unit of inverse mass
     Vector2 impulsePerIMass = contactNormal * impulse;
 
     // Apply impulses: they are applied in the direction of the contact,
-    // and are proportional to the inverse mass.
-    particle[0]->setVelocity(particle[0]->getVelocity() +
-        impulsePerIMass * particle[0]->getInverseMass()
-        );
-    if (particle[1])
+    // and are proportional to the inverse mass. Fixed particles aren't
+    // written at all, so contacts sharing one can be resolved at once.
+    if (store.inverseMass[a] > 0)
+    {
+        store.velocityX[a] += impulsePerIMass.x * store.inverseMass[a];
+        store.velocityY[a] += impulsePerIMass.y * store.inverseMass[a];
+    }
+    if (particle[1] && store.inverseMass[b] > 0)
     {
         // Particle 1 goes in the opposite direction
-        particle[1]->setVelocity(particle[1]->getVelocity() +
-            impulsePerIMass * -particle[1]->getInverseMass()
-            );
+        store.velocityX[b] -= impulsePerIMass.x * store.inverseMass[b];
+        store.velocityY[b] -= impulsePerIMass.y * store.inverseMass[b];
+    }
+}
+
+void ParticleContact::setSeparatingVelocity(float separatingVelocity)
+{
+    float deltaVelocity = separatingVelocity - calculateSeparatingVelocity();
+    if (deltaVelocity == 0) return;
+
+    ParticleStore &store = *particle[0]->getStore();
+    unsigned a = particle[0]->getIndex();
+    unsigned b = particle[1] ? particle[1]->getIndex() : 0;
+    float totalInverseMass = store.inverseMass[a];
+    if (particle[1]) totalInverseMass += store.inverseMass[b];
+    if (totalInverseMass <= 0) return;
+
+    // Split the change between the particles as resolveVelocity does
+    Vector2 impulsePerIMass = contactNormal * (deltaVelocity / totalInverseMass);
+    if (store.inverseMass[a] > 0)
+    {
+        store.velocityX[a] += impulsePerIMass.x * store.inverseMass[a];
+        store.velocityY[a] += impulsePerIMass.y * store.inverseMass[a];
+    }
+    if (particle[1] && store.inverseMass[b] > 0)
+    {
+        store.velocityX[b] -= impulsePerIMass.x * store.inverseMass[b];
+        store.velocityY[b] -= impulsePerIMass.y * store.inverseMass[b];
+    }
+}
+
+void ParticleContact::calculateInterpenetration(Vector2 move[2]) const
+{
+    move[0].clear();
+    move[1].clear();
+
+    // If we don't have any penetration, skip this step.
+    if (penetration <= 0) return;
+
+    // The movement of each object is based on their inverse mass, so
+    // total that.
+    float totalInverseMass = particle[0]->getInverseMass();
+    if (particle[1]) totalInverseMass += particle[1]->getInverseMass();
+
+    // If all particles have infinite mass, then we do nothing
+    if (totalInverseMass <= 0) return;
+
+    // Find the amount of penetration resolution per unit of inverse mass
+    Vector2 movePerIMass = contactNormal * (penetration / totalInverseMass);
+
+    // Calculate the the movement amounts
+    move[0] = movePerIMass * particle[0]->getInverseMass();
+    if (particle[1])
+    {
+        move[1] = movePerIMass * -particle[1]->getInverseMass();
     }
 }
 
 ParticleContactResolver::ParticleContactResolver(unsigned iterations)
 :
-iterations(iterations)
+iterations(iterations),
+iterationsUsed(0),
+positionIterations(8),
+positionIterationsUsed(0),
+penetrationTolerance(0.01f),
+velocityTolerance(0)
 {
 }
 
@@ -87,9 +160,10 @@ void ParticleContactResolver::resolveContacts(ParticleContact *contactArray,
         unsigned maxIndex = numContacts;
         for (i = 0; i < numContacts; i++)
         {
+            // Only closing contacts: resolving a separating one only
+            // changes its velocity, which it doesn't need
             float sepVel = contactArray[i].calculateSeparatingVelocity();
-            if (sepVel < max &&
-                (sepVel < 0 || contactArray[i].penetration > 0))
+            if (sepVel < max && sepVel < -velocityTolerance)
             {
                 max = sepVel;
                 maxIndex = i;
@@ -104,4 +178,277 @@ void ParticleContactResolver::resolveContacts(ParticleContact *contactArray,
         iterationsUsed++;
     }
 
-}
\ No newline at end of file
+    resolveInterpenetration(contactArray, numContacts);
+}
+
+void ParticleContactResolver::setPositionIterations(unsigned iterations)
+{
+    positionIterations = iterations;
+}
+
+void ParticleContactResolver::setPenetrationTolerance(float tolerance)
+{
+    penetrationTolerance = tolerance;
+}
+
+void ParticleContactResolver::setVelocityTolerance(float tolerance)
+{
+    velocityTolerance = tolerance;
+}
+
+unsigned ParticleContactResolver::getIterationsUsed() const
+{
+    return iterationsUsed;
+}
+
+float ParticleContactResolver::getPenetrationTolerance() const
+{
+    return penetrationTolerance;
+}
+
+unsigned ParticleContactResolver::getPositionIterationsUsed() const
+{
+    return positionIterationsUsed;
+}
+
+void ParticleContactResolver::resolveInterpenetration(ParticleContact *contactArray,
+                                                      unsigned numContacts)
+{
+    positionIterationsUsed = 0;
+    if (numContacts == 0) return;
+
+    ParticleStore &store = *contactArray[0].particle[0]->getStore();
+    if (moveX.size() < store.size())
+    {
+        moveX.resize(store.size(), 0);
+        moveY.resize(store.size(), 0);
+        moveShare.resize(store.size(), 0);
+    }
+
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        contactArray[i].particleMovement[0].clear();
+        contactArray[i].particleMovement[1].clear();
+    }
+
+    while (positionIterationsUsed < positionIterations)
+    {
+        // Is anything deep enough to be worth resolving?
+        float deepest = 0;
+        for (unsigned i = 0; i < numContacts; i++)
+        {
+            if (contactArray[i].penetration > deepest) deepest = contactArray[i].penetration;
+        }
+        if (deepest <= penetrationTolerance) break;
+
+        // Add up the movement each contact asks of its particles
+        for (unsigned i = 0; i < numContacts; i++)
+        {
+            const ParticleContact &contact = contactArray[i];
+            if (contact.penetration <= 0) continue;
+
+            Vector2 move[2];
+            contact.calculateInterpenetration(move);
+            for (unsigned p = 0; p < 2; p++)
+            {
+                // Fixed particles never move, so are left untouched
+                if (!contact.particle[p]) continue;
+                unsigned index = contact.particle[p]->getIndex();
+                if (store.inverseMass[index] <= 0) continue;
+                moveX[index] += move[p].x;
+                moveY[index] += move[p].y;
+                moveShare[index] += 1.0f;
+            }
+        }
+
+        // Move each particle by the average of what its contacts
+        // asked for. Afterwards moveX and moveY hold the distance
+        // each particle actually moved.
+        for (unsigned i = 0; i < numContacts; i++)
+        {
+            for (unsigned p = 0; p < 2; p++)
+            {
+                if (!contactArray[i].particle[p]) continue;
+                unsigned index = contactArray[i].particle[p]->getIndex();
+                if (moveShare[index] <= 0) continue;
+
+                moveX[index] /= moveShare[index];
+                moveY[index] /= moveShare[index];
+                moveShare[index] = 0;
+                store.positionX[index] += moveX[index];
+                store.positionY[index] += moveY[index];
+            }
+        }
+
+        // Update the penetration of every contact the moved
+        // particles are in
+        for (unsigned i = 0; i < numContacts; i++)
+        {
+            ParticleContact &contact = contactArray[i];
+            unsigned a = contact.particle[0]->getIndex();
+            Vector2 moved(moveX[a], moveY[a]);
+            contact.particleMovement[0] += moved;
+            if (contact.particle[1])
+            {
+                unsigned b = contact.particle[1]->getIndex();
+                Vector2 movedB(moveX[b], moveY[b]);
+                contact.particleMovement[1] += movedB;
+                moved -= movedB;
+            }
+            contact.penetration -= moved * contact.contactNormal;
+        }
+
+        // Clear the scratch space for the next pass
+        for (unsigned i = 0; i < numContacts; i++)
+        {
+            for (unsigned p = 0; p < 2; p++)
+            {
+                if (!contactArray[i].particle[p]) continue;
+                unsigned index = contactArray[i].particle[p]->getIndex();
+                moveX[index] = 0;
+                moveY[index] = 0;
+            }
+        }
+
+        positionIterationsUsed++;
+    }
+}
+
+void ParticleContactResolver::resolvePositions(ParticleContact *contactArray,
+                                               unsigned numContacts)
+{
+    positionIterationsUsed = 0;
+    if (numContacts == 0) return;
+
+    ParticleStore &store = *contactArray[0].particle[0]->getStore();
+    if (moveX.size() < store.size())
+    {
+        moveX.resize(store.size(), 0);
+        moveY.resize(store.size(), 0);
+        moveShare.resize(store.size(), 0);
+    }
+
+    // moveX and moveY hold how far each particle has moved so far,
+    // so every contact sees the moves the ones before it made
+    while (positionIterationsUsed < positionIterations)
+    {
+        float deepest = 0;
+        for (unsigned i = 0; i < numContacts; i++)
+        {
+            const ParticleContact &contact = contactArray[i];
+            unsigned a = contact.particle[0]->getIndex();
+            float movedX = moveX[a];
+            float movedY = moveY[a];
+            float totalInverseMass = store.inverseMass[a];
+            unsigned b = 0;
+            if (contact.particle[1])
+            {
+                b = contact.particle[1]->getIndex();
+                movedX -= moveX[b];
+                movedY -= moveY[b];
+                totalInverseMass += store.inverseMass[b];
+            }
+
+            float penetration = contact.penetration -
+                (movedX * contact.contactNormal.x + movedY * contact.contactNormal.y);
+            if (penetration <= penetrationTolerance || totalInverseMass <= 0) continue;
+            if (penetration > deepest) deepest = penetration;
+
+            // Push the particles apart in proportion to their inverse
+            // masses, fixed particles staying where they are
+            Vector2 movePerIMass = contact.contactNormal * (penetration / totalInverseMass);
+            if (store.inverseMass[a] > 0)
+            {
+                float x = movePerIMass.x * store.inverseMass[a];
+                float y = movePerIMass.y * store.inverseMass[a];
+                store.positionX[a] += x;
+                store.positionY[a] += y;
+                moveX[a] += x;
+                moveY[a] += y;
+            }
+            if (contact.particle[1] && store.inverseMass[b] > 0)
+            {
+                float x = movePerIMass.x * store.inverseMass[b];
+                float y = movePerIMass.y * store.inverseMass[b];
+                store.positionX[b] -= x;
+                store.positionY[b] -= y;
+                moveX[b] -= x;
+                moveY[b] -= y;
+            }
+        }
+        if (deepest == 0) break;
+        positionIterationsUsed++;
+    }
+
+    // Record the movement and leave the scratch space zeroed
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        ParticleContact &contact = contactArray[i];
+        unsigned a = contact.particle[0]->getIndex();
+        contact.particleMovement[0] = Vector2(moveX[a], moveY[a]);
+        Vector2 moved = contact.particleMovement[0];
+        contact.particleMovement[1].clear();
+        if (contact.particle[1])
+        {
+            unsigned b = contact.particle[1]->getIndex();
+            contact.particleMovement[1] = Vector2(moveX[b], moveY[b]);
+            moved -= contact.particleMovement[1];
+        }
+        contact.penetration -= moved * contact.contactNormal;
+    }
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        for (unsigned p = 0; p < 2; p++)
+        {
+            if (!contactArray[i].particle[p]) continue;
+            unsigned index = contactArray[i].particle[p]->getIndex();
+            moveX[index] = 0;
+            moveY[index] = 0;
+        }
+    }
+}
+
+unsigned ParticleContactGenerator::getPartitionCount() const
+{
+    return 1;
+}
+
+unsigned ParticleContactGenerator::addContactPartition(ParticleContact *contact,
+                                                       unsigned limit,
+                                                       unsigned partition) const
+{
+    if (partition != 0) return 0;
+    return addContact(contact, limit);
+}
+
+ParticleBatchContactGenerator::ParticleBatchContactGenerator(const ParticleStore::Handles *particles)
+:
+particles(particles)
+{
+}
+
+unsigned ParticleBatchContactGenerator::addContact(ParticleContact *contact,
+                                                  unsigned limit) const
+{
+    if (particles->empty()) return 0;
+    return addContactBatch(&(*particles)[0], (unsigned)particles->size(), contact, limit);
+}
+
+unsigned ParticleBatchContactGenerator::getPartitionCount() const
+{
+    unsigned count = (unsigned)particles->size();
+    return (count + PARTICLES_PER_PARTITION - 1) / PARTICLES_PER_PARTITION;
+}
+
+unsigned ParticleBatchContactGenerator::addContactPartition(ParticleContact *contact,
+                                                           unsigned limit,
+                                                           unsigned partition) const
+{
+    unsigned count = (unsigned)particles->size();
+    unsigned begin = partition * PARTICLES_PER_PARTITION;
+    if (begin >= count) return 0;
+
+    unsigned size = count - begin;
+    if (size > PARTICLES_PER_PARTITION) size = PARTICLES_PER_PARTITION;
+    return addContactBatch(&(*particles)[begin], size, contact, limit);
+}
@@ -0,0 +1,130 @@
+#include <math.h>
+#include <pgrid.h>
+
+ParticleGrid::ParticleGrid()
+:
+cellSize(1.0f),
+inverseCellSize(1.0f),
+tableMask(0),
+store(0),
+margins(0)
+{
+}
+
+unsigned ParticleGrid::hashCell(int x, int y) const
+{
+    // Large primes spread neighbouring cells over the table
+    return ((unsigned)x * 73856093u ^ (unsigned)y * 19349663u) & tableMask;
+}
+
+void ParticleGrid::build(const ParticleStore &store)
+{
+    ParticleGrid::store = &store;
+    unsigned count = store.size();
+    const std::vector<float> &positionX = store.positionX;
+    const std::vector<float> &positionY = store.positionY;
+    const std::vector<float> &radius = store.radius;
+
+    cellX.resize(count);
+    cellY.resize(count);
+    sortedIndex.resize(count);
+    extent.resize(count);
+
+    // Find the largest reach
+    float maxExtent = 0;
+    for (unsigned i = 0; i < count; i++)
+    {
+        extent[i] = margins ? radius[i] + (*margins)[i] : radius[i];
+        if (extent[i] > maxExtent) maxExtent = extent[i];
+    }
+
+    // Two touching particles can be at most two radii apart, so with
+    // cells that big they are never more than one cell away.
+    cellSize = maxExtent > 0 ? 2.0f * maxExtent : 1.0f;
+    inverseCellSize = 1.0f / cellSize;
+
+    // Keep the table about half full
+    unsigned tableSize = 16;
+    while (tableSize < count * 2) tableSize <<= 1;
+    tableMask = tableSize - 1;
+    bucketStart.assign(tableSize + 1, 0);
+
+    // Counting sort of the particles by bucket
+    for (unsigned i = 0; i < count; i++)
+    {
+        cellX[i] = (int)floor(positionX[i] * inverseCellSize);
+        cellY[i] = (int)floor(positionY[i] * inverseCellSize);
+        bucketStart[hashCell(cellX[i], cellY[i]) + 1]++;
+    }
+    for (unsigned b = 0; b < tableSize; b++)
+    {
+        bucketStart[b + 1] += bucketStart[b];
+    }
+
+    // Use the end of the table as a fill cursor then shift it back
+    for (unsigned i = 0; i < count; i++)
+    {
+        unsigned bucket = hashCell(cellX[i], cellY[i]);
+        sortedIndex[bucketStart[bucket]++] = i;
+    }
+    for (unsigned b = tableSize; b > 0; b--)
+    {
+        bucketStart[b] = bucketStart[b - 1];
+    }
+    bucketStart[0] = 0;
+}
+
+void ParticleGrid::findPairs(ParticlePairs &pairs) const
+{
+    pairs.clear();
+    if (!store) return;
+
+    const std::vector<float> &positionX = store->positionX;
+    const std::vector<float> &positionY = store->positionY;
+
+    unsigned count = (unsigned)sortedIndex.size();
+    for (unsigned i = 0; i < count; i++)
+    {
+        for (int dy = -1; dy <= 1; dy++)
+        {
+            for (int dx = -1; dx <= 1; dx++)
+            {
+                int x = cellX[i] + dx;
+                int y = cellY[i] + dy;
+                unsigned bucket = hashCell(x, y);
+
+                for (unsigned k = bucketStart[bucket];
+                    k < bucketStart[bucket + 1];
+                    k++)
+                {
+                    unsigned j = sortedIndex[k];
+
+                    // Report each pair once, and skip particles that
+                    // only share the bucket through a hash collision.
+                    if (j <= i) continue;
+                    if (cellX[j] != x || cellY[j] != y) continue;
+
+                    // Bounding box test
+                    float reach = extent[i] + extent[j];
+                    if (fabs(positionX[i] - positionX[j]) > reach) continue;
+                    if (fabs(positionY[i] - positionY[j]) > reach) continue;
+
+                    ParticlePair pair;
+                    pair.index[0] = i;
+                    pair.index[1] = j;
+                    pairs.push_back(pair);
+                }
+            }
+        }
+    }
+}
+
+void ParticleGrid::setMargins(const std::vector<float> *margins)
+{
+    ParticleGrid::margins = margins;
+}
+
+float ParticleGrid::getCellSize() const
+{
+    return cellSize;
+}
@@ -0,0 +1,185 @@
+#include <float.h>
+#include <pheap.h>
+
+ParticleHeapResolver::ParticleHeapResolver(unsigned iterations)
+:
+ParticleContactResolver(iterations)
+{
+}
+
+bool ParticleHeapResolver::before(unsigned a, unsigned b) const
+{
+    // Matches the scan in ParticleContactResolver, which keeps the
+    // first contact it finds with the smallest value.
+    if (key[a] != key[b]) return key[a] < key[b];
+    return a < b;
+}
+
+void ParticleHeapResolver::siftUp(unsigned slot)
+{
+    unsigned contact = heap[slot];
+    while (slot > 0)
+    {
+        unsigned parent = (slot - 1) / 2;
+        if (!before(contact, heap[parent])) break;
+        heap[slot] = heap[parent];
+        heapSlot[heap[slot]] = slot;
+        slot = parent;
+    }
+    heap[slot] = contact;
+    heapSlot[contact] = slot;
+}
+
+void ParticleHeapResolver::siftDown(unsigned slot)
+{
+    unsigned contact = heap[slot];
+    unsigned size = (unsigned)heap.size();
+    for (;;)
+    {
+        unsigned child = slot * 2 + 1;
+        if (child >= size) break;
+        if (child + 1 < size && before(heap[child + 1], heap[child])) child++;
+        if (!before(heap[child], contact)) break;
+        heap[slot] = heap[child];
+        heapSlot[heap[slot]] = slot;
+        slot = child;
+    }
+    heap[slot] = contact;
+    heapSlot[contact] = slot;
+}
+
+void ParticleHeapResolver::update(ParticleContact *contactArray, unsigned contact)
+{
+    // The same test as the scan in ParticleContactResolver
+    const float max = DBL_MAX;
+    float sepVel = contactArray[contact].calculateSeparatingVelocity();
+    bool wanted = sepVel < max && sepVel < -velocityTolerance;
+    unsigned slot = heapSlot[contact];
+
+    if (!wanted)
+    {
+        if (slot == NOT_QUEUED) return;
+
+        // Move the last entry into the gap and restore the order
+        unsigned last = heap.back();
+        heap.pop_back();
+        heapSlot[contact] = NOT_QUEUED;
+        if (last == contact) return;
+
+        heap[slot] = last;
+        heapSlot[last] = slot;
+        siftUp(slot);
+        siftDown(heapSlot[last]);
+        return;
+    }
+
+    key[contact] = sepVel;
+    if (slot == NOT_QUEUED)
+    {
+        heap.push_back(contact);
+        siftUp((unsigned)heap.size() - 1);
+    }
+    else
+    {
+        siftUp(slot);
+        siftDown(heapSlot[contact]);
+    }
+}
+
+void ParticleHeapResolver::buildAdjacency(ParticleContact *contactArray,
+                                          unsigned numContacts)
+{
+    // Give each movable particle a local index, so nothing here
+    // scales with the size of the store
+    const ParticleStore &store = *contactArray[0].particle[0]->getStore();
+    if (localIndex.size() < store.size()) localIndex.resize(store.size(), (unsigned)NO_LOCAL);
+    touched.clear();
+    contactLocal.resize(numContacts * 2);
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        for (unsigned p = 0; p < 2; p++)
+        {
+            Particle *particle = contactArray[i].particle[p];
+            unsigned local = NO_LOCAL;
+            if (particle && store.inverseMass[particle->getIndex()] > 0)
+            {
+                unsigned index = particle->getIndex();
+                if (localIndex[index] == NO_LOCAL)
+                {
+                    localIndex[index] = (unsigned)touched.size();
+                    touched.push_back(index);
+                }
+                local = localIndex[index];
+            }
+            contactLocal[i * 2 + p] = local;
+        }
+    }
+
+    // Leave the map clear for the next call
+    unsigned particles = (unsigned)touched.size();
+    for (unsigned p = 0; p < particles; p++) localIndex[touched[p]] = NO_LOCAL;
+
+    adjacencyStart.assign(particles + 1, 0);
+    for (unsigned c = 0; c < numContacts * 2; c++)
+    {
+        if (contactLocal[c] != NO_LOCAL) adjacencyStart[contactLocal[c] + 1]++;
+    }
+    for (unsigned p = 0; p < particles; p++)
+    {
+        adjacencyStart[p + 1] += adjacencyStart[p];
+    }
+
+    // Fill using the starts as cursors, then shift them back
+    adjacency.resize(adjacencyStart[particles]);
+    for (unsigned c = 0; c < numContacts * 2; c++)
+    {
+        if (contactLocal[c] != NO_LOCAL) adjacency[adjacencyStart[contactLocal[c]]++] = c / 2;
+    }
+    for (unsigned p = particles; p > 0; p--)
+    {
+        adjacencyStart[p] = adjacencyStart[p - 1];
+    }
+    adjacencyStart[0] = 0;
+}
+
+void ParticleHeapResolver::resolveContacts(ParticleContact *contactArray,
+                                           unsigned numContacts,
+                                           float duration)
+{
+    iterationsUsed = 0;
+    if (numContacts == 0) return;
+
+    buildAdjacency(contactArray, numContacts);
+
+    // Queue every contact worth resolving
+    heap.clear();
+    heapSlot.assign(numContacts, (unsigned)NOT_QUEUED);
+    key.resize(numContacts);
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        update(contactArray, i);
+    }
+
+    while (iterationsUsed < iterations && !heap.empty())
+    {
+        // The contact with the largest closing velocity is on top
+        unsigned worst = heap[0];
+        contactArray[worst].resolve(duration);
+
+        // Only contacts sharing a movable particle with it have changed
+        for (unsigned p = 0; p < 2; p++)
+        {
+            unsigned local = contactLocal[worst * 2 + p];
+            if (local == NO_LOCAL) continue;
+
+            for (unsigned a = adjacencyStart[local]; a < adjacencyStart[local + 1]; a++)
+            {
+                update(contactArray, adjacency[a]);
+            }
+        }
+
+        iterationsUsed++;
+    }
+
+    resolveInterpenetration(contactArray, numContacts);
+}
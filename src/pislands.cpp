@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <pislands.h>
+
+ParticleIslands::ThreadResolver::ThreadResolver()
+:
+resolver(0),
+heapResolver(0),
+iterationsUsed(0)
+{
+}
+
+ParticleIslands::ParticleIslands(WorkerPool *workers, unsigned iterations)
+:
+workers(workers),
+iterations(iterations),
+iterationsUsed(0),
+velocityTolerance(0)
+{
+}
+
+void ParticleIslands::setIterations(unsigned iterations)
+{
+    ParticleIslands::iterations = iterations;
+}
+
+void ParticleIslands::setVelocityTolerance(float tolerance)
+{
+    velocityTolerance = tolerance;
+}
+
+unsigned ParticleIslands::getIterationsUsed() const
+{
+    return iterationsUsed;
+}
+
+unsigned ParticleIslands::getIslandCount() const
+{
+    return (unsigned)islandOrder.size();
+}
+
+unsigned ParticleIslands::getIsland(unsigned particle) const
+{
+    if (particle >= particleIsland.size()) return NO_ISLAND;
+    return particleIsland[particle];
+}
+
+unsigned ParticleIslands::find(unsigned particle)
+{
+    while (parent[particle] != particle)
+    {
+        parent[particle] = parent[parent[particle]];
+        particle = parent[particle];
+    }
+    return particle;
+}
+
+void ParticleIslands::build(ParticleContact *contactArray, unsigned numContacts)
+{
+    const ParticleStore &store = *contactArray[0].particle[0]->getStore();
+    unsigned particles = store.size();
+
+    parent.resize(particles);
+    for (unsigned p = 0; p < particles; p++) parent[p] = p;
+    rootIsland.assign(particles, (unsigned)NO_ISLAND);
+    particleIsland.assign(particles, (unsigned)NO_ISLAND);
+
+    // Join the two particles of every contact, unless one of them
+    // can't move
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        const ParticleContact &contact = contactArray[i];
+        if (!contact.particle[1]) continue;
+
+        unsigned a = contact.particle[0]->getIndex();
+        unsigned b = contact.particle[1]->getIndex();
+        if (store.inverseMass[a] <= 0 || store.inverseMass[b] <= 0) continue;
+
+        a = find(a);
+        b = find(b);
+        if (a == b) continue;
+        if (a < b) parent[b] = a;
+        else parent[a] = b;
+    }
+
+    // Number the islands in the order their first contact appears,
+    // and count their contacts
+    unsigned islandCount = 0;
+    contactIsland.resize(numContacts);
+    islandStart.clear();
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        contactIsland[i] = NO_ISLAND;
+        for (unsigned p = 0; p < 2; p++)
+        {
+            Particle *particle = contactArray[i].particle[p];
+            if (!particle || store.inverseMass[particle->getIndex()] <= 0) continue;
+
+            unsigned index = particle->getIndex();
+            unsigned root = find(index);
+            if (rootIsland[root] == NO_ISLAND)
+            {
+                rootIsland[root] = islandCount++;
+                islandStart.push_back(0);
+            }
+            particleIsland[index] = rootIsland[root];
+            contactIsland[i] = rootIsland[root];
+        }
+        if (contactIsland[i] != NO_ISLAND) islandStart[contactIsland[i]]++;
+    }
+
+    // Turn the counts into starts, then copy the contacts out. A
+    // contact with nothing that can move is left out.
+    islandStart.push_back(0);
+    unsigned total = 0;
+    for (unsigned island = 0; island <= islandCount; island++)
+    {
+        unsigned count = islandStart[island];
+        islandStart[island] = total;
+        total += count;
+    }
+
+    islandContacts.resize(total);
+    islandSource.resize(total);
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        unsigned island = contactIsland[i];
+        if (island == NO_ISLAND) continue;
+
+        unsigned slot = islandStart[island]++;
+        islandContacts[slot] = contactArray[i];
+        islandSource[slot] = i;
+    }
+    for (unsigned island = islandCount; island > 0; island--)
+    {
+        islandStart[island] = islandStart[island - 1];
+    }
+    islandStart[0] = 0;
+
+    // Largest first, ties in island order
+    islandOrder.resize(islandCount);
+    for (unsigned island = 0; island < islandCount; island++) islandOrder[island] = island;
+    const std::vector<unsigned> &start = islandStart;
+    std::sort(islandOrder.begin(), islandOrder.end(),
+        [&start](unsigned a, unsigned b)
+        {
+            unsigned sizeA = start[a + 1] - start[a];
+            unsigned sizeB = start[b + 1] - start[b];
+            if (sizeA != sizeB) return sizeA > sizeB;
+            return a < b;
+        });
+}
+
+void ParticleIslands::resolveContacts(ParticleContact *contactArray,
+                                      unsigned numContacts,
+                                      float duration)
+{
+    // With no contacts there are no islands, and nothing is left in
+    // the ones from the last call
+    iterationsUsed = 0;
+    islandOrder.clear();
+    if (numContacts == 0)
+    {
+        particleIsland.clear();
+        return;
+    }
+
+    build(contactArray, numContacts);
+
+    unsigned threadCount = workers->getThreadSlots();
+    if (threadResolvers.size() < threadCount) threadResolvers.resize(threadCount);
+    for (unsigned t = 0; t < threadCount; t++)
+    {
+        threadResolvers[t].resolver.setVelocityTolerance(velocityTolerance);
+        threadResolvers[t].heapResolver.setVelocityTolerance(velocityTolerance);
+        threadResolvers[t].iterationsUsed = 0;
+    }
+
+    workers->parallelForIndexed(0, (unsigned)islandOrder.size(), 1,
+        [this, duration](unsigned begin, unsigned end, unsigned thread)
+    {
+        ThreadResolver &solver = threadResolvers[thread];
+        for (unsigned i = begin; i < end; i++)
+        {
+            unsigned island = islandOrder[i];
+            unsigned first = islandStart[island];
+            unsigned count = islandStart[island + 1] - first;
+            unsigned budget = iterations ? iterations : count * 2;
+
+            if (count > HEAP_CONTACTS)
+            {
+                solver.heapResolver.setIterations(budget);
+                solver.heapResolver.resolveContacts(&islandContacts[first], count, duration);
+                solver.iterationsUsed += solver.heapResolver.getIterationsUsed();
+            }
+            else
+            {
+                solver.resolver.setIterations(budget);
+                solver.resolver.resolveContacts(&islandContacts[first], count, duration);
+                solver.iterationsUsed += solver.resolver.getIterationsUsed();
+            }
+        }
+    });
+
+    for (unsigned t = 0; t < threadCount; t++)
+    {
+        iterationsUsed += threadResolvers[t].iterationsUsed;
+    }
+
+    // Hand the resolved contacts back in their original order
+    for (unsigned i = 0; i < islandContacts.size(); i++)
+    {
+        contactArray[islandSource[i]] = islandContacts[i];
+    }
+}
@@ -0,0 +1,188 @@
+#include <pjacobi.h>
+
+ParticleJacobiResolver::ParticleJacobiResolver(WorkerPool *workers,
+                                               unsigned iterations)
+:
+iterations(iterations),
+iterationsUsed(0),
+velocityTolerance(0.01f),
+relaxation(1.0f),
+workers(workers)
+{
+}
+
+void ParticleJacobiResolver::setIterations(unsigned iterations)
+{
+    ParticleJacobiResolver::iterations = iterations;
+}
+
+void ParticleJacobiResolver::setVelocityTolerance(float tolerance)
+{
+    velocityTolerance = tolerance;
+}
+
+void ParticleJacobiResolver::setRelaxation(float relaxation)
+{
+    ParticleJacobiResolver::relaxation = relaxation;
+}
+
+unsigned ParticleJacobiResolver::getIterationsUsed() const
+{
+    return iterationsUsed;
+}
+
+void ParticleJacobiResolver::gather(ParticleContact *contactArray,
+                                    unsigned numContacts)
+{
+    ParticleStore &store = *contactArray[0].particle[0]->getStore();
+    if (localIndex.size() < store.size()) localIndex.resize(store.size(), (unsigned)NO_SLOT);
+
+    bodyA.resize(numContacts);
+    bodyB.resize(numContacts);
+    normalX.resize(numContacts);
+    normalY.resize(numContacts);
+    restitutionFactor.resize(numContacts);
+    inverseMassTotal.resize(numContacts);
+    relativeX.resize(numContacts);
+    relativeY.resize(numContacts);
+    separatingVelocity.resize(numContacts);
+    impulse.resize(numContacts);
+    storeIndex.clear();
+
+    // Give each particle a local slot the first time it turns up
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        const ParticleContact &contact = contactArray[i];
+        for (unsigned p = 0; p < 2; p++)
+        {
+            unsigned *body = p ? &bodyB[i] : &bodyA[i];
+            if (!contact.particle[p])
+            {
+                *body = NO_SLOT;
+                continue;
+            }
+
+            unsigned index = contact.particle[p]->getIndex();
+            if (localIndex[index] == NO_SLOT)
+            {
+                localIndex[index] = (unsigned)storeIndex.size();
+                storeIndex.push_back(index);
+            }
+            *body = localIndex[index];
+        }
+
+        normalX[i] = contact.contactNormal.x;
+        normalY[i] = contact.contactNormal.y;
+        restitutionFactor[i] = 1.0f + contact.restitution;
+
+        float totalInverseMass = store.inverseMass[contact.particle[0]->getIndex()];
+        if (contact.particle[1]) totalInverseMass += store.inverseMass[contact.particle[1]->getIndex()];
+        inverseMassTotal[i] = totalInverseMass > 0 ? 1.0f / totalInverseMass : 0.0f;
+    }
+
+    // The last slot stands in for the scenery: immovable and at rest
+    unsigned bodies = (unsigned)storeIndex.size();
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        if (bodyB[i] == NO_SLOT) bodyB[i] = bodies;
+    }
+
+    velocityX.resize(bodies + 1);
+    velocityY.resize(bodies + 1);
+    inverseMass.resize(bodies + 1);
+    deltaX.assign(bodies + 1, 0);
+    deltaY.assign(bodies + 1, 0);
+    contactShare.assign(bodies + 1, 0);
+    for (unsigned b = 0; b < bodies; b++)
+    {
+        velocityX[b] = store.velocityX[storeIndex[b]];
+        velocityY[b] = store.velocityY[storeIndex[b]];
+        inverseMass[b] = store.inverseMass[storeIndex[b]];
+    }
+    velocityX[bodies] = velocityY[bodies] = inverseMass[bodies] = 0;
+
+    // Each particle gets the average of its contacts' changes
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        contactShare[bodyA[i]] += 1.0f;
+        contactShare[bodyB[i]] += 1.0f;
+    }
+    for (unsigned b = 0; b <= bodies; b++)
+    {
+        contactShare[b] = contactShare[b] > 0 ? relaxation / contactShare[b] : 0.0f;
+    }
+}
+
+void ParticleJacobiResolver::scatter(ParticleStore &store)
+{
+    for (unsigned b = 0; b < storeIndex.size(); b++)
+    {
+        store.velocityX[storeIndex[b]] = velocityX[b];
+        store.velocityY[storeIndex[b]] = velocityY[b];
+
+        // Leave the map clear for the next solve
+        localIndex[storeIndex[b]] = NO_SLOT;
+    }
+}
+
+void ParticleJacobiResolver::resolveContacts(ParticleContact *contactArray,
+                                             unsigned numContacts,
+                                             float /*duration*/)
+{
+    iterationsUsed = 0;
+    if (numContacts == 0) return;
+
+    ParticleStore &store = *contactArray[0].particle[0]->getStore();
+    gather(contactArray, numContacts);
+    unsigned bodies = (unsigned)velocityX.size();
+
+    while (iterationsUsed < iterations)
+    {
+        // Work out every contact's impulse from the same velocities
+        workers->parallelFor(0, numContacts, 0, [this](unsigned begin, unsigned end)
+        {
+            for (unsigned i = begin; i < end; i++)
+            {
+                relativeX[i] = velocityX[bodyA[i]] - velocityX[bodyB[i]];
+                relativeY[i] = velocityY[bodyA[i]] - velocityY[bodyB[i]];
+            }
+            batchDot(&separatingVelocity[begin], &relativeX[begin], &relativeY[begin],
+                &normalX[begin], &normalY[begin], end - begin);
+
+            // Only closing contacts get an impulse; the new
+            // separating velocity is -restitution times the old one
+            for (unsigned i = begin; i < end; i++)
+            {
+                float wanted = -separatingVelocity[i] * restitutionFactor[i];
+                impulse[i] = (wanted > 0 ? wanted : 0) * inverseMassTotal[i];
+            }
+        });
+
+        float worst = 0;
+        for (unsigned i = 0; i < numContacts; i++)
+        {
+            if (-separatingVelocity[i] > worst) worst = -separatingVelocity[i];
+        }
+        if (velocityTolerance > 0 && worst <= velocityTolerance) break;
+
+        // Accumulate the changes per particle
+        for (unsigned i = 0; i < numContacts; i++)
+        {
+            float changeX = normalX[i] * impulse[i];
+            float changeY = normalY[i] * impulse[i];
+            deltaX[bodyA[i]] += changeX * inverseMass[bodyA[i]];
+            deltaY[bodyA[i]] += changeY * inverseMass[bodyA[i]];
+            deltaX[bodyB[i]] -= changeX * inverseMass[bodyB[i]];
+            deltaY[bodyB[i]] -= changeY * inverseMass[bodyB[i]];
+        }
+
+        // And apply them all together
+        batchAxpyWeighted(&velocityX[0], &deltaX[0], &contactShare[0], 1.0f, bodies);
+        batchAxpyWeighted(&velocityY[0], &deltaY[0], &contactShare[0], 1.0f, bodies);
+        for (unsigned b = 0; b < bodies; b++) deltaX[b] = deltaY[b] = 0;
+
+        iterationsUsed++;
+    }
+
+    scatter(store);
+}
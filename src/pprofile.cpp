@@ -0,0 +1,239 @@
+#include <iomanip>
+#include <pprofile.h>
+
+ParticleProfiler::Scope::Scope(ParticleProfiler &profiler, Phase phase)
+:
+profiler(profiler),
+phase(phase),
+start(std::chrono::steady_clock::now())
+{
+}
+
+ParticleProfiler::Scope::~Scope()
+{
+    profiler.addPhaseTime(phase, start);
+}
+
+ParticleProfiler::ParticleProfiler()
+:
+epoch(std::chrono::steady_clock::now()),
+events(MAX_FRAME_EVENTS),
+eventCount(0),
+history(HISTORY_FRAMES),
+historyNext(0),
+historySize(0),
+tracing(false),
+frameCount(0)
+{
+    beginFrame();
+}
+
+bool ParticleProfiler::isCompiledIn()
+{
+#ifdef SPHERE_PROFILE
+    return true;
+#else
+    return false;
+#endif
+}
+
+const char* ParticleProfiler::getPhaseName(Phase phase)
+{
+    static const char *names[PHASE_COUNT] = {
+        "frame", "integrate", "broadphase", "narrowphase", "resolve", "sleep"
+    };
+    return names[phase];
+}
+
+const char* ParticleProfiler::getCounterName(Counter counter)
+{
+    static const char *names[COUNTER_COUNT] = {
+        "pairs", "contacts", "dropped", "iterations", "awake", "steps"
+    };
+    return names[counter];
+}
+
+double ParticleProfiler::since(std::chrono::steady_clock::time_point time) const
+{
+    return std::chrono::duration<double, std::micro>(time - epoch).count();
+}
+
+void ParticleProfiler::beginFrame()
+{
+    current.number = frameCount;
+    for (unsigned p = 0; p < PHASE_COUNT; p++) current.phaseTime[p] = 0;
+    for (unsigned c = 0; c < COUNTER_COUNT; c++) current.counter[c] = 0;
+    eventCount = 0;
+    current.start = since(std::chrono::steady_clock::now());
+}
+
+void ParticleProfiler::endFrame()
+{
+    double now = since(std::chrono::steady_clock::now());
+    current.phaseTime[PHASE_FRAME] = (float)(now - current.start);
+
+    history[historyNext] = current;
+    historyNext = (historyNext + 1) % HISTORY_FRAMES;
+    if (historySize < HISTORY_FRAMES) historySize++;
+
+    // Stop rather than grow once the reserved room is used up
+    if (tracing)
+    {
+        trace.push_back(current);
+        traceEvents.insert(traceEvents.end(), events.begin(), events.begin() + eventCount);
+        if (trace.size() == trace.capacity()) tracing = false;
+    }
+
+    frameCount++;
+}
+
+void ParticleProfiler::addPhaseTime(Phase phase, std::chrono::steady_clock::time_point start)
+{
+    double begin = since(start);
+    double end = since(std::chrono::steady_clock::now());
+    current.phaseTime[phase] += (float)(end - begin);
+
+    if (eventCount < MAX_FRAME_EVENTS)
+    {
+        Event &event = events[eventCount++];
+        event.phase = phase;
+        event.start = begin;
+        event.duration = (float)(end - begin);
+    }
+}
+
+void ParticleProfiler::setCounter(Counter counter, unsigned value)
+{
+    current.counter[counter] = value;
+}
+
+void ParticleProfiler::startTrace(unsigned maxFrames)
+{
+    std::vector<Frame>().swap(trace);
+    std::vector<Event>().swap(traceEvents);
+    trace.reserve(maxFrames);
+    traceEvents.reserve(maxFrames * MAX_FRAME_EVENTS);
+    tracing = maxFrames > 0;
+}
+
+void ParticleProfiler::stopTrace()
+{
+    tracing = false;
+}
+
+unsigned ParticleProfiler::getTraceSize() const
+{
+    return (unsigned)trace.size();
+}
+
+void ParticleProfiler::writeTrace(std::ostream &out) const
+{
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(3);
+
+    // Frames and scopes are complete ("X") events on one thread,
+    // which nest since the scopes never overlap. Counters are counter
+    // ("C") events, which the viewer draws as graphs.
+    out << "{\"traceEvents\":[\n";
+    bool first = true;
+    for (unsigned e = 0; e < traceEvents.size(); e++)
+    {
+        const Event &event = traceEvents[e];
+        if (!first) out << ",\n";
+        first = false;
+        out << "{\"name\":\"" << getPhaseName(event.phase) << "\",\"cat\":\"physics\",\"ph\":\"X\""
+            << ",\"ts\":" << event.start << ",\"dur\":" << event.duration << ",\"pid\":1,\"tid\":1}";
+    }
+    for (unsigned f = 0; f < trace.size(); f++)
+    {
+        const Frame &frame = trace[f];
+        if (!first) out << ",\n";
+        first = false;
+        out << "{\"name\":\"" << getPhaseName(PHASE_FRAME) << "\",\"cat\":\"physics\",\"ph\":\"X\""
+            << ",\"ts\":" << frame.start << ",\"dur\":" << frame.phaseTime[PHASE_FRAME]
+            << ",\"pid\":1,\"tid\":1,\"args\":{\"frame\":" << frame.number << "}}";
+
+        out << ",\n{\"name\":\"counters\",\"ph\":\"C\",\"ts\":" << frame.start
+            << ",\"pid\":1,\"args\":{";
+        for (unsigned c = 0; c < COUNTER_COUNT; c++)
+        {
+            if (c) out << ",";
+            out << "\"" << getCounterName((Counter)c) << "\":" << frame.counter[c];
+        }
+        out << "}}";
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    out.flags(flags);
+    out.precision(precision);
+}
+
+unsigned ParticleProfiler::getFrameCount() const
+{
+    return frameCount;
+}
+
+const ParticleProfiler::Frame& ParticleProfiler::getLastFrame() const
+{
+    return history[(historyNext + HISTORY_FRAMES - 1) % HISTORY_FRAMES];
+}
+
+ParticleProfiler::Summary ParticleProfiler::getPhaseSummary(Phase phase) const
+{
+    Summary summary = { 0, 0, 0 };
+    for (unsigned f = 0; f < historySize; f++)
+    {
+        float time = history[f].phaseTime[phase];
+        if (f == 0 || time < summary.minimum) summary.minimum = time;
+        if (f == 0 || time > summary.maximum) summary.maximum = time;
+        summary.average += time;
+    }
+    if (historySize) summary.average /= historySize;
+    return summary;
+}
+
+ParticleProfiler::Summary ParticleProfiler::getCounterSummary(Counter counter) const
+{
+    Summary summary = { 0, 0, 0 };
+    for (unsigned f = 0; f < historySize; f++)
+    {
+        float value = (float)history[f].counter[counter];
+        if (f == 0 || value < summary.minimum) summary.minimum = value;
+        if (f == 0 || value > summary.maximum) summary.maximum = value;
+        summary.average += value;
+    }
+    if (historySize) summary.average /= historySize;
+    return summary;
+}
+
+void ParticleProfiler::writeSummary(std::ostream &out) const
+{
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+
+    out << "last " << historySize << " frames\n";
+    out << std::left << std::setw(17) << "" << std::right << std::setw(12) << "average"
+        << std::setw(10) << "min" << std::setw(10) << "max" << "\n";
+    out << std::fixed << std::setprecision(3);
+    for (unsigned p = 0; p < PHASE_COUNT; p++)
+    {
+        Summary summary = getPhaseSummary((Phase)p);
+        out << std::left << std::setw(14) << getPhaseName((Phase)p) << " ms" << std::right
+            << std::setw(12) << summary.average / 1000.0f
+            << std::setw(10) << summary.minimum / 1000.0f
+            << std::setw(10) << summary.maximum / 1000.0f << "\n";
+    }
+    out << std::setprecision(1);
+    for (unsigned c = 0; c < COUNTER_COUNT; c++)
+    {
+        Summary summary = getCounterSummary((Counter)c);
+        out << std::left << std::setw(17) << getCounterName((Counter)c) << std::right
+            << std::setw(12) << summary.average
+            << std::setw(10) << summary.minimum
+            << std::setw(10) << summary.maximum << "\n";
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
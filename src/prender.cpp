@@ -0,0 +1,119 @@
+#include <gl/glut.h>
+#include <prender.h>
+
+ParticleRenderer::ParticleRenderer()
+:
+particleCount(0),
+texture(0)
+{
+}
+
+void ParticleRenderer::pack(const ParticleSnapshot &snapshot, float blend)
+{
+    particleCount = snapshot.size();
+    vertices.resize(particleCount * 4);
+
+    // The corners of every quad, as offsets in units of the radius
+    // and as texture coordinates
+    static const float cornerX[4] = { -1, 1, 1, -1 };
+    static const float cornerY[4] = { -1, -1, 1, 1 };
+
+    Vertex *vertex = particleCount ? &vertices[0] : 0;
+    for (unsigned i = 0; i < particleCount; i++)
+    {
+        float x = snapshot.previousX[i] + (snapshot.positionX[i] - snapshot.previousX[i]) * blend;
+        float y = snapshot.previousY[i] + (snapshot.positionY[i] - snapshot.previousY[i]) * blend;
+        float radius = snapshot.radius[i];
+        unsigned char red = (unsigned char)(snapshot.red[i] * 255.0f + 0.5f);
+        unsigned char green = (unsigned char)(snapshot.green[i] * 255.0f + 0.5f);
+        unsigned char blue = (unsigned char)(snapshot.blue[i] * 255.0f + 0.5f);
+
+        for (unsigned c = 0; c < 4; c++, vertex++)
+        {
+            vertex->x = x + cornerX[c] * radius;
+            vertex->y = y + cornerY[c] * radius;
+            vertex->u = cornerX[c] * 0.5f + 0.5f;
+            vertex->v = cornerY[c] * 0.5f + 0.5f;
+            vertex->red = red;
+            vertex->green = green;
+            vertex->blue = blue;
+            vertex->alpha = 255;
+        }
+    }
+}
+
+void ParticleRenderer::createTexture()
+{
+    // White everywhere, opaque inside the circle and clear outside.
+    // Alpha is sampled at texel centres so the edge is symmetric.
+    std::vector<unsigned char> texels(TEXTURE_SIZE * TEXTURE_SIZE * 4, 255);
+    float centre = TEXTURE_SIZE * 0.5f;
+    for (unsigned y = 0; y < TEXTURE_SIZE; y++)
+    {
+        for (unsigned x = 0; x < TEXTURE_SIZE; x++)
+        {
+            float dx = (x + 0.5f - centre) / centre;
+            float dy = (y + 0.5f - centre) / centre;
+            texels[(y * TEXTURE_SIZE + x) * 4 + 3] = dx * dx + dy * dy <= 1.0f ? 255 : 0;
+        }
+    }
+
+    GLuint name;
+    glGenTextures(1, &name);
+    texture = name;
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, TEXTURE_SIZE, TEXTURE_SIZE, 0,
+        GL_RGBA, GL_UNSIGNED_BYTE, &texels[0]);
+}
+
+void ParticleRenderer::draw()
+{
+    if (particleCount == 0) return;
+
+    glPushAttrib(GL_ENABLE_BIT | GL_TEXTURE_BIT | GL_COLOR_BUFFER_BIT);
+    glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+
+    if (!texture) createTexture();
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+    glEnable(GL_ALPHA_TEST);
+    glAlphaFunc(GL_GREATER, 0.5f);
+    glDisable(GL_LIGHTING);
+
+    // One interleaved array, one draw
+    const Vertex *first = &vertices[0];
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(2, GL_FLOAT, sizeof(Vertex), &first->x);
+    glTexCoordPointer(2, GL_FLOAT, sizeof(Vertex), &first->u);
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(Vertex), &first->red);
+    glDrawArrays(GL_QUADS, 0, particleCount * 4);
+
+    glPopClientAttrib();
+    glPopAttrib();
+}
+
+void ParticleRenderer::releaseTexture()
+{
+    if (!texture) return;
+
+    GLuint name = texture;
+    glDeleteTextures(1, &name);
+    texture = 0;
+}
+
+unsigned ParticleRenderer::getParticleCount() const
+{
+    return particleCount;
+}
+
+const ParticleRenderer::Vertex* ParticleRenderer::getVertices() const
+{
+    return vertices.empty() ? 0 : &vertices[0];
+}
@@ -0,0 +1,208 @@
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+#include <psegments.h>
+
+unsigned segmentContact(const Vector2 &start, const Vector2 &end,
+                        Particle *particle, float restitution,
+                        ParticleContact *contact)
+{
+    // Check for penetration
+    Vector2 toParticle = particle->getPosition() - start;
+    Vector2 lineDirection = end - start;
+
+    float projected = toParticle * lineDirection;
+    float platformSqLength = lineDirection.squareMagnitude();
+    float radius = particle->getRadius();
+    float squareRadius = radius * radius;
+
+    if (projected <= 0)
+    {
+        // The particle is nearest to the start point
+        if (toParticle.squareMagnitude() >= squareRadius) return 0;
+
+        contact->contactNormal = toParticle.unit();
+        contact->penetration = radius - toParticle.magnitude();
+    }
+    else if (projected >= platformSqLength)
+    {
+        // The particle is nearest to the end point
+        toParticle = particle->getPosition() - end;
+        if (toParticle.squareMagnitude() >= squareRadius) return 0;
+
+        contact->contactNormal = toParticle.unit();
+        contact->penetration = radius - toParticle.magnitude();
+    }
+    else
+    {
+        // The particle is nearest to the middle
+        float distanceToPlatform = toParticle.squareMagnitude() - projected*projected / platformSqLength;
+        if (distanceToPlatform >= squareRadius) return 0;
+
+        // Rounding can take it just below zero for a particle on the line
+        if (distanceToPlatform < 0) distanceToPlatform = 0;
+
+        Vector2 closestPoint = start + lineDirection*(projected/platformSqLength);
+        contact->contactNormal = (particle->getPosition()-closestPoint).unit();
+        contact->penetration = radius - sqrt(distanceToPlatform);
+    }
+
+    contact->restitution = restitution;
+    contact->particle[0] = particle;
+    contact->particle[1] = 0;
+    return 1;
+}
+
+ParticleSegmentGenerator::ParticleSegmentGenerator(ParticleWorld *world,
+                                                   float restitution)
+:
+ParticleBatchContactGenerator(&world->getParticles()),
+restitution(restitution)
+{
+}
+
+void ParticleSegmentGenerator::addSegment(const Vector2 &start, const Vector2 &end)
+{
+    segmentStart.push_back(start);
+    segmentEnd.push_back(end);
+}
+
+unsigned ParticleSegmentGenerator::getSegmentCount() const
+{
+    return (unsigned)segmentStart.size();
+}
+
+unsigned ParticleSegmentGenerator::getNodeCount() const
+{
+    return (unsigned)nodes.size();
+}
+
+void ParticleSegmentGenerator::build()
+{
+    nodes.clear();
+    unsigned count = (unsigned)segmentStart.size();
+    if (count == 0) return;
+
+    std::vector<unsigned> order(count);
+    for (unsigned i = 0; i < count; i++) order[i] = i;
+    nodes.reserve(2 * count / SEGMENTS_PER_LEAF + 1);
+    buildNode(order, 0, count);
+
+    // Put the segments in tree order so each leaf's are together
+    std::vector<Vector2> start(count), end(count);
+    for (unsigned i = 0; i < count; i++)
+    {
+        start[i] = segmentStart[order[i]];
+        end[i] = segmentEnd[order[i]];
+    }
+    segmentStart.swap(start);
+    segmentEnd.swap(end);
+}
+
+unsigned ParticleSegmentGenerator::buildNode(std::vector<unsigned> &order,
+                                             unsigned first, unsigned count)
+{
+    unsigned index = (unsigned)nodes.size();
+    nodes.push_back(Node());
+
+    // Bound the segments, and their midpoints to choose the split
+    Node node;
+    node.minX = node.minY = FLT_MAX;
+    node.maxX = node.maxY = -FLT_MAX;
+    float midMinX = FLT_MAX, midMinY = FLT_MAX;
+    float midMaxX = -FLT_MAX, midMaxY = -FLT_MAX;
+    for (unsigned i = first; i < first + count; i++)
+    {
+        const Vector2 &a = segmentStart[order[i]];
+        const Vector2 &b = segmentEnd[order[i]];
+        node.minX = std::min(node.minX, std::min(a.x, b.x));
+        node.minY = std::min(node.minY, std::min(a.y, b.y));
+        node.maxX = std::max(node.maxX, std::max(a.x, b.x));
+        node.maxY = std::max(node.maxY, std::max(a.y, b.y));
+
+        float midX = (a.x + b.x) * 0.5f;
+        float midY = (a.y + b.y) * 0.5f;
+        midMinX = std::min(midMinX, midX);
+        midMinY = std::min(midMinY, midY);
+        midMaxX = std::max(midMaxX, midX);
+        midMaxY = std::max(midMaxY, midY);
+    }
+
+    if (count <= SEGMENTS_PER_LEAF)
+    {
+        node.secondChild = 0;
+        node.firstSegment = first;
+        node.segmentCount = count;
+        nodes[index] = node;
+        return index;
+    }
+
+    // Split at the median midpoint along the longer side
+    bool alongX = midMaxX - midMinX >= midMaxY - midMinY;
+    const std::vector<Vector2> &start = segmentStart;
+    const std::vector<Vector2> &end = segmentEnd;
+    unsigned half = count / 2;
+    std::nth_element(order.begin() + first, order.begin() + first + half,
+        order.begin() + first + count,
+        [&](unsigned a, unsigned b)
+        {
+            if (alongX) return start[a].x + end[a].x < start[b].x + end[b].x;
+            return start[a].y + end[a].y < start[b].y + end[b].y;
+        });
+
+    node.firstSegment = first;
+    node.segmentCount = 0;
+    buildNode(order, first, half);
+    node.secondChild = buildNode(order, first + half, count - half);
+    nodes[index] = node;
+    return index;
+}
+
+unsigned ParticleSegmentGenerator::addContactBatch(Particle *const *batch,
+                                                   unsigned count,
+                                                   ParticleContact *contact,
+                                                   unsigned limit) const
+{
+    if (nodes.empty() || count == 0) return 0;
+
+    const ParticleStore &store = *batch[0]->getStore();
+
+    // The tree is balanced, so this is far deeper than it can get
+    unsigned stack[64];
+    unsigned used = 0;
+    for (unsigned k = 0; k < count; k++)
+    {
+        unsigned i = batch[k]->getIndex();
+        float r = store.radius[i];
+        float minX = store.positionX[i] - r;
+        float maxX = store.positionX[i] + r;
+        float minY = store.positionY[i] - r;
+        float maxY = store.positionY[i] + r;
+
+        unsigned depth = 0;
+        stack[depth++] = 0;
+        while (depth > 0)
+        {
+            const Node &node = nodes[stack[--depth]];
+            if (node.minX > maxX || node.maxX < minX) continue;
+            if (node.minY > maxY || node.maxY < minY) continue;
+
+            if (node.segmentCount == 0)
+            {
+                stack[depth++] = node.secondChild;
+                stack[depth++] = (unsigned)(&node - &nodes[0]) + 1;
+                continue;
+            }
+
+            for (unsigned s = node.firstSegment; s < node.firstSegment + node.segmentCount; s++)
+            {
+                if (used == limit) return used;
+                unsigned added = segmentContact(segmentStart[s], segmentEnd[s],
+                    batch[k], restitution, contact);
+                used += added;
+                contact += added;
+            }
+        }
+    }
+    return used;
+}
@@ -0,0 +1,102 @@
+#include <psnapshot.h>
+
+ParticleSnapshotBuffer::ParticleSnapshotBuffer()
+:
+latest((unsigned)NONE),
+published(0),
+skipped(0)
+{
+    for (unsigned i = 0; i < 3; i++)
+    {
+        readers[i] = 0;
+        snapshots[i].frame = 0;
+        snapshots[i].stamp = 0;
+    }
+}
+
+bool ParticleSnapshotBuffer::publish(const ParticleStore &store, double stamp)
+{
+    // Find a snapshot that is neither the latest nor held. A reader
+    // that pins one of these after the check sees that it isn't the
+    // latest and lets go again before reading it.
+    unsigned current = latest.load();
+    unsigned target = NONE;
+    for (unsigned i = 0; i < 3; i++)
+    {
+        if (i != current && readers[i].load() == 0)
+        {
+            target = i;
+            break;
+        }
+    }
+    if (target == NONE)
+    {
+        skipped++;
+        return false;
+    }
+
+    ParticleSnapshot &snapshot = snapshots[target];
+    snapshot.frame = ++published;
+    snapshot.stamp = stamp;
+    snapshot.positionX = store.positionX;
+    snapshot.positionY = store.positionY;
+    snapshot.radius = store.radius;
+    snapshot.red = store.red;
+    snapshot.green = store.green;
+    snapshot.blue = store.blue;
+
+    // The latest snapshot is only ever read, so it is safe to copy
+    // the previous positions from it
+    unsigned count = snapshot.size();
+    unsigned carried = 0;
+    if (current != NONE)
+    {
+        const ParticleSnapshot &previous = snapshots[current];
+        carried = previous.size() < count ? previous.size() : count;
+        snapshot.previousX.assign(previous.positionX.begin(), previous.positionX.begin() + carried);
+        snapshot.previousY.assign(previous.positionY.begin(), previous.positionY.begin() + carried);
+    }
+    else
+    {
+        snapshot.previousX.clear();
+        snapshot.previousY.clear();
+    }
+    snapshot.previousX.insert(snapshot.previousX.end(),
+        snapshot.positionX.begin() + carried, snapshot.positionX.end());
+    snapshot.previousY.insert(snapshot.previousY.end(),
+        snapshot.positionY.begin() + carried, snapshot.positionY.end());
+
+    latest.store(target);
+    return true;
+}
+
+const ParticleSnapshot* ParticleSnapshotBuffer::acquire()
+{
+    for (;;)
+    {
+        unsigned index = latest.load();
+        if (index == NONE) return 0;
+
+        // Pin it, then make sure it is still the latest: if not, the
+        // publisher may already be writing into it
+        readers[index]++;
+        if (latest.load() == index) return &snapshots[index];
+        readers[index]--;
+    }
+}
+
+void ParticleSnapshotBuffer::release(const ParticleSnapshot *snapshot)
+{
+    if (!snapshot) return;
+    readers[snapshot - snapshots]--;
+}
+
+unsigned ParticleSnapshotBuffer::getPublishedCount() const
+{
+    return published;
+}
+
+unsigned ParticleSnapshotBuffer::getSkippedCount() const
+{
+    return skipped;
+}
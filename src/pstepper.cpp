@@ -0,0 +1,126 @@
+#include <pstepper.h>
+
+ParticleStepper::ParticleStepper(ParticleWorld *world, float stepDuration)
+:
+world(world),
+stepDuration(stepDuration),
+maxCatchUpSteps(5),
+running(false),
+stepCount(0)
+{
+}
+
+ParticleStepper::~ParticleStepper()
+{
+    stop();
+}
+
+void ParticleStepper::start(const StepFunction &step)
+{
+    if (thread.joinable()) return;
+
+    ParticleStepper::step = step;
+    stepCount = 0;
+
+    // Publish the starting state, so there is something to draw
+    epoch = Clock::now();
+    publish(epoch);
+
+    running = true;
+    thread = std::thread(&ParticleStepper::run, this);
+}
+
+void ParticleStepper::stop()
+{
+    running = false;
+    if (thread.joinable()) thread.join();
+}
+
+bool ParticleStepper::isRunning() const
+{
+    return running;
+}
+
+void ParticleStepper::setStepDuration(float duration)
+{
+    stepDuration = duration;
+}
+
+float ParticleStepper::getStepDuration() const
+{
+    return stepDuration;
+}
+
+void ParticleStepper::setMaxCatchUpSteps(unsigned steps)
+{
+    maxCatchUpSteps = steps;
+}
+
+unsigned ParticleStepper::getStepCount() const
+{
+    return stepCount;
+}
+
+void ParticleStepper::run()
+{
+    Clock::duration interval = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<float>(stepDuration));
+    Clock::time_point due = Clock::now() + interval;
+
+    while (running)
+    {
+        Clock::time_point now = Clock::now();
+        if (now < due)
+        {
+            std::this_thread::sleep_until(due);
+            continue;
+        }
+
+        // Drop any backlog we couldn't run in time
+        if (now - due > interval * maxCatchUpSteps) due = now;
+
+        step(stepDuration);
+        stepCount++;
+        publish(due);
+        due += interval;
+    }
+}
+
+void ParticleStepper::publish(Clock::time_point due)
+{
+    world->publishSnapshot(std::chrono::duration<double>(due - epoch).count());
+}
+
+float ParticleStepper::getBlend(const ParticleSnapshot &snapshot) const
+{
+    double now = std::chrono::duration<double>(Clock::now() - epoch).count();
+    float blend = (float)((now - snapshot.stamp) / stepDuration);
+    if (blend < 0) blend = 0;
+    if (blend > 1) blend = 1;
+    return blend;
+}
+
+float ParticleStepper::getInterpolatedPositions(std::vector<float> &x,
+                                                std::vector<float> &y) const
+{
+    const ParticleSnapshot *snapshot = world->acquireSnapshot();
+    if (!snapshot)
+    {
+        x.clear();
+        y.clear();
+        return 0;
+    }
+
+    float blend = getBlend(*snapshot);
+    unsigned count = snapshot->size();
+    x.resize(count);
+    y.resize(count);
+    for (unsigned i = 0; i < count; i++)
+    {
+        x[i] = snapshot->previousX[i] + (snapshot->positionX[i] - snapshot->previousX[i]) * blend;
+        y[i] = snapshot->previousY[i] + (snapshot->positionY[i] - snapshot->previousY[i]) * blend;
+    }
+
+    world->releaseSnapshot(snapshot);
+    return blend;
+}
@@ -0,0 +1,102 @@
+#include <new>
+#include <pstore.h>
+#include <particle.h>
+
+ParticleStore::ParticleStore()
+{
+}
+
+ParticleStore::~ParticleStore()
+{
+    for (Handles::iterator h = handles.begin(); h != handles.end(); h++)
+    {
+        (*h)->~Particle();
+    }
+    for (unsigned s = 0; s < slabs.size(); s++)
+    {
+        ::operator delete(slabs[s]);
+    }
+}
+
+Particle* ParticleStore::create()
+{
+    unsigned index = size();
+
+    inverseMass.push_back(0);
+    damping.push_back(1);
+    radius.push_back(0);
+    positionX.push_back(0);
+    positionY.push_back(0);
+    velocityX.push_back(0);
+    velocityY.push_back(0);
+    forceAccumX.push_back(0);
+    forceAccumY.push_back(0);
+    accelerationX.push_back(0);
+    accelerationY.push_back(0);
+    awake.push_back(true);
+    averageVelocityX.push_back(0);
+    averageVelocityY.push_back(0);
+    sleepTime.push_back(0);
+
+    ID.push_back(index);
+    collisionStatus.push_back(false);
+    red.push_back(0);
+    green.push_back(0);
+    blue.push_back(0);
+
+    // Start a new slab when the last one is full
+    unsigned slot = index % PARTICLES_PER_SLAB;
+    if (slot == 0 && index / PARTICLES_PER_SLAB == slabs.size())
+    {
+        void *memory = ::operator new(sizeof(Particle) * PARTICLES_PER_SLAB);
+        slabs.push_back(static_cast<Particle*>(memory));
+    }
+
+    Particle *particle = new (slabs[index / PARTICLES_PER_SLAB] + slot) Particle(this, index);
+    handles.push_back(particle);
+    return particle;
+}
+
+void ParticleStore::reserve(unsigned count)
+{
+    inverseMass.reserve(count);
+    damping.reserve(count);
+    radius.reserve(count);
+    positionX.reserve(count);
+    positionY.reserve(count);
+    velocityX.reserve(count);
+    velocityY.reserve(count);
+    forceAccumX.reserve(count);
+    forceAccumY.reserve(count);
+    accelerationX.reserve(count);
+    accelerationY.reserve(count);
+    awake.reserve(count);
+    averageVelocityX.reserve(count);
+    averageVelocityY.reserve(count);
+    sleepTime.reserve(count);
+
+    ID.reserve(count);
+    collisionStatus.reserve(count);
+    red.reserve(count);
+    green.reserve(count);
+    blue.reserve(count);
+
+    handles.reserve(count);
+    unsigned slabCount = (count + PARTICLES_PER_SLAB - 1) / PARTICLES_PER_SLAB;
+    slabs.reserve(slabCount);
+    while (slabs.size() < slabCount)
+    {
+        void *memory = ::operator new(sizeof(Particle) * PARTICLES_PER_SLAB);
+        slabs.push_back(static_cast<Particle*>(memory));
+    }
+}
+
+unsigned ParticleStore::size() const
+{
+    return (unsigned)handles.size();
+}
+
+const ParticleStore::Handles& ParticleStore::getHandles() const
+{
+    return handles;
+}
@@ -0,0 +1,118 @@
+#include <math.h>
+#include <psweep.h>
+
+ParticleSweepAndPrune::ParticleSweepAndPrune()
+:
+store(0),
+margins(0),
+swaps(0)
+{
+}
+
+void ParticleSweepAndPrune::update(const ParticleStore &store)
+{
+    unsigned count = store.size();
+
+    // A different or shrunk store can't reuse the old order
+    if (ParticleSweepAndPrune::store != &store || order.size() > count)
+    {
+        order.clear();
+    }
+    ParticleSweepAndPrune::store = &store;
+
+    for (unsigned i = (unsigned)order.size(); i < count; i++)
+    {
+        order.push_back(i);
+    }
+    sortedMinX.resize(count);
+    sortedMaxX.resize(count);
+    sortedX.resize(count);
+    sortedY.resize(count);
+    sortedRadius.resize(count);
+
+    // Refresh the boxes in last frame's order, grown by the margins so
+    // the pair test below grows with them
+    for (unsigned k = 0; k < count; k++)
+    {
+        unsigned i = order[k];
+        float r = margins ? store.radius[i] + (*margins)[i] : store.radius[i];
+        sortedMinX[k] = store.positionX[i] - r;
+        sortedMaxX[k] = store.positionX[i] + r;
+        sortedX[k] = store.positionX[i];
+        sortedY[k] = store.positionY[i];
+        sortedRadius[k] = r;
+    }
+
+    // Insertion sort, nearly free when little has changed
+    swaps = 0;
+    for (unsigned k = 1; k < count; k++)
+    {
+        float minX = sortedMinX[k];
+        if (!(minX < sortedMinX[k - 1])) continue;
+
+        unsigned index = order[k];
+        float maxX = sortedMaxX[k];
+        float x = sortedX[k];
+        float y = sortedY[k];
+        float radius = sortedRadius[k];
+
+        unsigned m = k;
+        while (m > 0 && minX < sortedMinX[m - 1])
+        {
+            order[m] = order[m - 1];
+            sortedMinX[m] = sortedMinX[m - 1];
+            sortedMaxX[m] = sortedMaxX[m - 1];
+            sortedX[m] = sortedX[m - 1];
+            sortedY[m] = sortedY[m - 1];
+            sortedRadius[m] = sortedRadius[m - 1];
+            m--;
+        }
+        swaps += k - m;
+
+        order[m] = index;
+        sortedMinX[m] = minX;
+        sortedMaxX[m] = maxX;
+        sortedX[m] = x;
+        sortedY[m] = y;
+        sortedRadius[m] = radius;
+    }
+}
+
+void ParticleSweepAndPrune::findPairs(ParticlePairs &pairs) const
+{
+    pairs.clear();
+
+    unsigned count = (unsigned)order.size();
+    for (unsigned k = 0; k < count; k++)
+    {
+        float maxX = sortedMaxX[k];
+
+        // Everything after this starts further along, so the boxes
+        // overlap on x until one starts past this box's end
+        for (unsigned m = k + 1; m < count && sortedMinX[m] <= maxX; m++)
+        {
+            // The same box test as the grid, so both find the same
+            // pairs even for boxes that only just touch
+            float reach = sortedRadius[k] + sortedRadius[m];
+            if (fabs(sortedX[k] - sortedX[m]) > reach) continue;
+            if (fabs(sortedY[k] - sortedY[m]) > reach) continue;
+
+            ParticlePair pair;
+            unsigned a = order[k];
+            unsigned b = order[m];
+            pair.index[0] = a < b ? a : b;
+            pair.index[1] = a < b ? b : a;
+            pairs.push_back(pair);
+        }
+    }
+}
+
+void ParticleSweepAndPrune::setMargins(const std::vector<float> *margins)
+{
+    ParticleSweepAndPrune::margins = margins;
+}
+
+unsigned ParticleSweepAndPrune::getSwapCount() const
+{
+    return swaps;
+}
@@ -0,0 +1,174 @@
+#include <assert.h>
+#include <pworkers.h>
+
+WorkerPool::WorkerPool(unsigned threadCount)
+:
+generation(0),
+active(0),
+stopping(false),
+spareUsers(0),
+body(0),
+bodyCall(0),
+next(0),
+end(0),
+grain(1)
+{
+    setThreadCount(threadCount);
+}
+
+WorkerPool::~WorkerPool()
+{
+    stopThreads();
+}
+
+void WorkerPool::setThreadCount(unsigned threadCount)
+{
+    if (threadCount == 0)
+    {
+        threadCount = std::thread::hardware_concurrency();
+        if (threadCount == 0) threadCount = 1;
+    }
+
+    std::lock_guard<std::mutex> lock(dispatch);
+    if (threadCount == getThreadCount()) return;
+    stopThreads();
+    startThreads(threadCount - 1);
+}
+
+unsigned WorkerPool::getThreadCount() const
+{
+    return (unsigned)threads.size() + 1;
+}
+
+unsigned WorkerPool::getThreadSlots() const
+{
+    return getThreadCount() + 1;
+}
+
+void WorkerPool::startThreads(unsigned count)
+{
+    // New workers only join loops posted after they start, not the
+    // last one to have run
+    unsigned current;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = false;
+        current = generation;
+    }
+    for (unsigned i = 0; i < count; i++)
+    {
+        threads.push_back(std::thread(&WorkerPool::workerMain, this, i + 1, current));
+    }
+}
+
+void WorkerPool::stopThreads()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (unsigned i = 0; i < threads.size(); i++)
+    {
+        threads[i].join();
+    }
+    threads.clear();
+}
+
+unsigned WorkerPool::chunkSize(unsigned count) const
+{
+    unsigned chunks = getThreadCount() * 4;
+    unsigned size = (count + chunks - 1) / chunks;
+
+    // Round up to whole cache lines
+    size = (size + CACHE_LINE_FLOATS - 1) / CACHE_LINE_FLOATS * CACHE_LINE_FLOATS;
+    if (size == 0) size = CACHE_LINE_FLOATS;
+    return size;
+}
+
+void WorkerPool::runChunks(unsigned threadIndex)
+{
+    for (;;)
+    {
+        unsigned start = next.fetch_add(grain);
+        if (start >= end) return;
+
+        unsigned stop = end - start < grain ? end : start + grain;
+        bodyCall(body, start, stop, threadIndex);
+    }
+}
+
+void WorkerPool::workerMain(unsigned threadIndex, unsigned seen)
+{
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!stopping && generation == seen) wake.wait(lock);
+            if (stopping) return;
+            seen = generation;
+        }
+
+        runChunks(threadIndex);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--active == 0) done.notify_one();
+        }
+    }
+}
+
+void WorkerPool::run(unsigned begin, unsigned end, unsigned grain,
+                     const void *body, BodyCall bodyCall, bool indexed)
+{
+    if (begin >= end) return;
+    if (grain == 0) grain = chunkSize(end - begin);
+
+    // Nested or concurrent calls run inline, on the spare index so
+    // they don't share buffers with a thread of the running loop
+    std::unique_lock<std::mutex> claim(dispatch, std::try_to_lock);
+    if (!claim.owns_lock())
+    {
+        if (!indexed)
+        {
+            bodyCall(body, begin, end, 0);
+            return;
+        }
+
+        unsigned users = ++spareUsers;
+        assert(users == 1 && "two indexed loops running inline at once");
+        (void)users;
+        bodyCall(body, begin, end, getThreadCount());
+        spareUsers--;
+        return;
+    }
+
+    // So do small loops and single threaded pools, which have the
+    // pool to themselves
+    if (threads.empty() || end - begin <= grain)
+    {
+        bodyCall(body, begin, end, 0);
+        return;
+    }
+
+    // Post the loop and wake the workers
+    WorkerPool::body = body;
+    WorkerPool::bodyCall = bodyCall;
+    WorkerPool::end = end;
+    WorkerPool::grain = grain;
+    next.store(begin);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        active = (unsigned)threads.size();
+        generation++;
+    }
+    wake.notify_all();
+
+    // Help out, then wait for the stragglers
+    runChunks(0);
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (active != 0) done.wait(lock);
+    }
+}
@@ -1,78 +1,970 @@
 
 #include <cstdlib>
+#include <math.h>
+#include <string.h>
 #include <pworld.h>
 
+const float ParticleWorld::SPECULATIVE_MARGIN_FLOOR = 0.05f;
+
 ParticleWorld::ParticleWorld(unsigned maxContacts, unsigned iterations)
 :
 resolver(iterations),
-maxContacts(maxContacts)
+colouredResolver(&workers, 16),
+heapResolver(iterations),
+jacobiResolver(&workers, 16),
+islands(&workers, iterations),
+resolverMode(RESOLVE_SEQUENTIAL),
+integratorMode(INTEGRATE_EULER),
+stepMode(STEP_IMPULSES),
+substepCount(8),
+stepFraction(0),
+maxStepCount(16),
+stepCount(1),
+framePairs(0),
+frameContacts(0),
+frameDropped(0),
+frameIterations(0),
+positionResolver(0),
+contacts(maxContacts),
+contactLimit(0),
+warmStarting(false),
+sleeping(false),
+sleepEnergy(0.1f),
+sleepWindow(0.5f),
+islandSleeping(false),
+awakeCount(0),
+broadphaseMode(BROADPHASE_GRID),
+dragDuration(0),
+parallelContacts(false)
 {
-    contacts = new ParticleContact[maxContacts];
     calculateIterations = (iterations == 0);
+    positionResolver.setPenetrationTolerance(0.001f);
 
 }
 
 ParticleWorld::~ParticleWorld()
 {
-    delete[] contacts;
 }
 
 unsigned ParticleWorld::generateContacts()
 {
-    unsigned limit = maxContacts;
-    ParticleContact *nextContact = contacts;
+    contacts.reset();
+    if (parallelContacts) contacts.setUsed(generateContactsParallel());
+    else
+    {
+        unsigned used = 0;
+        for (ContactGenerators::iterator g = contactGenerators.begin();
+            g != contactGenerators.end();
+            g++)
+        {
+            for (;;)
+            {
+                unsigned space = contacts.getCapacity() - used;
+                unsigned added = (*g)->addContact(contacts.at(used), space);
 
+                // If the generator filled the space it may have had
+                // more, so grow and run it again from the same place.
+                if (added < space)
+                {
+                    used += added;
+                    break;
+                }
+                contacts.reserve(contacts.getCapacity() + 1);
+            }
+        }
+        contacts.setUsed(used);
+    }
+
+    // Return the number of contacts used.
+    if (contactLimit) return contacts.limit(contactLimit);
+    return contacts.getUsed();
+}
+
+unsigned ParticleWorld::generateContactsParallel()
+{
+    // Break the work down into one task per generator partition
+    contactTasks.clear();
     for (ContactGenerators::iterator g = contactGenerators.begin();
         g != contactGenerators.end();
         g++)
     {
-        unsigned used =(*g)->addContact(nextContact, limit);
-        limit -= used;
-        nextContact += used;
+        unsigned partitions = (*g)->getPartitionCount();
+        for (unsigned p = 0; p < partitions; p++)
+        {
+            ContactTask task;
+            task.generator = *g;
+            task.partition = p;
+            task.thread = 0;
+            task.offset = 0;
+            task.count = 0;
+            task.output = 0;
+            contactTasks.push_back(task);
+        }
+    }
+    if (contactTasks.empty()) return 0;
 
-        // We've run out of contacts to fill. This means we're missing
-        // contacts.
-        if (limit <= 0) break;
+    // Each thread gets its own buffer, which it grows itself as
+    // needed. They start as big as the arena.
+    unsigned threads = workers.getThreadSlots();
+    if (contactBuffers.size() < threads) contactBuffers.resize(threads);
+    for (unsigned t = 0; t < threads; t++)
+    {
+        if (contactBuffers[t].contacts.size() < contacts.getCapacity())
+        {
+            contactBuffers[t].contacts.resize(contacts.getCapacity());
+        }
+        contactBuffers[t].used = 0;
     }
 
-    // Return the number of contacts used.
-    return maxContacts - limit;
+    workers.parallelForIndexed(0, (unsigned)contactTasks.size(), 1,
+        [this](unsigned begin, unsigned end, unsigned thread)
+    {
+        ContactBuffer &buffer = contactBuffers[thread];
+        for (unsigned i = begin; i < end; i++)
+        {
+            ContactTask &task = contactTasks[i];
+            task.thread = thread;
+            task.offset = buffer.used;
+            for (;;)
+            {
+                unsigned space = (unsigned)buffer.contacts.size() - buffer.used;
+                task.count = task.generator->addContactPartition(
+                    &buffer.contacts[0] + buffer.used, space, task.partition);
+                if (task.count < space) break;
+
+                // Full, so there may be more: grow and run it again
+                buffer.contacts.resize(buffer.contacts.size() * 2 + 1);
+            }
+            buffer.used += task.count;
+        }
+    });
+
+    // Prefix sum over the tasks in generator order, then make room
+    unsigned used = 0;
+    for (unsigned i = 0; i < contactTasks.size(); i++)
+    {
+        ContactTask &task = contactTasks[i];
+        task.output = used;
+        used += task.count;
+    }
+    contacts.reserve(used);
+
+    // Copy each task's contacts into place
+    workers.parallelFor(0, (unsigned)contactTasks.size(), 1,
+        [this](unsigned begin, unsigned end)
+    {
+        for (unsigned i = begin; i < end; i++)
+        {
+            const ContactTask &task = contactTasks[i];
+            const ParticleContact *source =
+                task.count ? &contactBuffers[task.thread].contacts[task.offset] : 0;
+            for (unsigned c = 0; c < task.count; c++)
+            {
+                *contacts.at(task.output + c) = source[c];
+            }
+        }
+    });
+
+    return used;
 }
 
-void ParticleWorld::integrate(float duration)
+void ParticleWorld::integrate(float duration, bool predict, bool keepForces)
 {
-    for (Particles::iterator p = particles.begin();
-        p != particles.end();
-        p++)
+    unsigned count = store.size();
+    if (count == 0) return;
+
+    integrationMask.resize(count);
+    forceScale.resize(count);
+    if (dragFactor.size() != count || dragDuration != duration)
     {
-        // Remove all forces from the accumulator
-        (*p)->integrate(duration);
+        // Force every drag factor to be recomputed
+        dragFactor.resize(count);
+        dragDamping.assign(count, -1.0f);
+        dragDuration = duration;
+    }
+
+    // The step constants are the same for every chunk
+    IntegrationStep step(duration);
+    workers.parallelFor(0, count, 0, [this, &step, predict, keepForces](unsigned begin, unsigned end)
+    {
+        integrateRange(begin, end, step, predict, keepForces);
+    });
+}
+
+/**
+ * Runs the given policy over a span, with or without drag. Each
+ * combination is a separate instantiation with no branches inside.
+ */
+template <class Integrator>
+static void integrateSpan(const IntegrationSpan &span, const IntegrationStep &step, bool damped)
+{
+    if (damped) Integrator::template integrate<true>(span, step);
+    else Integrator::template integrate<false>(span, step);
+}
+
+void ParticleWorld::integrateRange(unsigned begin, unsigned end, const IntegrationStep &step,
+                                   bool predict, bool keepForces)
+{
+    unsigned count = end - begin;
+
+    // Work out which particles move, and by how much their forces
+    // and drag affect them. We don't integrate things with zero mass,
+    // or things that are asleep.
+    bool anyMoves = false;
+    bool anyDamped = false;
+    for (unsigned i = begin; i < end; i++)
+    {
+        float inverseMass = store.inverseMass[i];
+        bool moves = inverseMass > 0.0f && store.awake[i];
+        anyMoves = anyMoves || moves;
+        integrationMask[i] = moves ? 1.0f : 0.0f;
+        forceScale[i] = moves ? inverseMass : 0.0f;
+
+        if (!moves)
+        {
+            // Fixed particles keep whatever velocity they have, and
+            // sleeping ones have none
+            dragFactor[i] = 1.0f;
+            dragDamping[i] = -1.0f;
+            continue;
+        }
+
+        float damping = store.damping[i];
+        anyDamped = anyDamped || damping != 1.0f;
+        if (dragDamping[i] != damping)
+        {
+            dragDamping[i] = damping;
+            dragFactor[i] = damping == 1.0f ? 1.0f : (float)pow(damping, step.duration);
+        }
+    }
+
+    float *forceAccumX = &store.forceAccumX[begin];
+    float *forceAccumY = &store.forceAccumY[begin];
+
+    // A chunk of a settled pile has nothing to do
+    if (anyMoves)
+    {
+        IntegrationSpan span;
+        span.positionX = &store.positionX[begin];
+        span.positionY = &store.positionY[begin];
+        span.velocityX = &store.velocityX[begin];
+        span.velocityY = &store.velocityY[begin];
+        span.accelerationX = &store.accelerationX[begin];
+        span.accelerationY = &store.accelerationY[begin];
+        span.forceAccumX = forceAccumX;
+        span.forceAccumY = forceAccumY;
+        span.mask = &integrationMask[begin];
+        span.forceScale = &forceScale[begin];
+        span.dragFactor = &dragFactor[begin];
+        span.count = count;
+
+        // Predicted velocities are replaced by the movement, so they
+        // have to be updated before the particles move
+        if (predict || integratorMode == INTEGRATE_SYMPLECTIC_EULER)
+        {
+            integrateSpan<ParticleSymplecticEulerIntegrator>(span, step, anyDamped);
+        }
+        else if (integratorMode == INTEGRATE_VERLET)
+        {
+            integrateSpan<ParticleVerletIntegrator>(span, step, anyDamped);
+        }
+        else
+        {
+            integrateSpan<ParticleEulerIntegrator>(span, step, anyDamped);
+        }
+    }
+
+    // Remove all forces from the accumulator, unless there are more
+    // steps of the frame to come
+    if (keepForces) return;
+    memset(forceAccumX, 0, count * sizeof(float));
+    memset(forceAccumY, 0, count * sizeof(float));
+}
+
+void ParticleWorld::broadphase()
+{
+    if (broadphaseMode == BROADPHASE_SWEEP)
+    {
+        sweep.update(store);
+        sweep.findPairs(candidatePairs);
+    }
+    else
+    {
+        grid.build(store);
+        grid.findPairs(candidatePairs);
+    }
+
+    // Two sleeping particles can't start moving into each other
+    if (sleeping)
+    {
+        unsigned kept = 0;
+        for (unsigned i = 0; i < candidatePairs.size(); i++)
+        {
+            const ParticlePair &pair = candidatePairs[i];
+            if (!store.awake[pair.index[0]] && !store.awake[pair.index[1]]) continue;
+            candidatePairs[kept++] = pair;
+        }
+        candidatePairs.resize(kept);
     }
 }
 
 void ParticleWorld::runPhysics(float duration)
 {
+    PROFILE_BEGIN_FRAME(profiler);
 
+    // The steps add their counts to these
+    framePairs = 0;
+    frameContacts = 0;
+    frameDropped = 0;
+    frameIterations = 0;
+
+    unsigned steps = stepFraction > 0 ? findStepCount(duration) : 1;
+    if (stepMode == STEP_POSITIONS)
+    {
+        // The broadphase margins already cover the whole frame, so
+        // only the substeps need to be shorter
+        unsigned substeps = substepCount > steps ? substepCount : steps;
+        if (substeps == 0) substeps = 1;
+        stepPositions(duration, substeps);
+        stepCount = substeps;
+
+        if (sleeping)
+        {
+            PROFILE_SCOPE(profiler, PHASE_SLEEP);
+            updateSleep(duration);
+        }
+    }
+    else
+    {
+        // A split frame applies its forces in every step, and clears
+        // them once at the end
+        float stepDuration = duration / steps;
+        for (unsigned s = 0; s < steps; s++)
+        {
+            stepImpulses(stepDuration, steps > 1);
+
+            if (sleeping)
+            {
+                PROFILE_SCOPE(profiler, PHASE_SLEEP);
+                updateSleep(stepDuration);
+            }
+        }
+        if (steps > 1) clearForces();
+        stepCount = steps;
+    }
+    if (!sleeping) awakeCount = store.size();
+    PROFILE_COUNTER(profiler, COUNTER_PAIRS, framePairs);
+    PROFILE_COUNTER(profiler, COUNTER_CONTACTS, frameContacts);
+    PROFILE_COUNTER(profiler, COUNTER_DROPPED, frameDropped);
+    PROFILE_COUNTER(profiler, COUNTER_ITERATIONS, frameIterations);
+    PROFILE_COUNTER(profiler, COUNTER_STEPS, stepCount);
+    PROFILE_COUNTER(profiler, COUNTER_AWAKE, awakeCount);
+
+    PROFILE_END_FRAME(profiler);
+}
+
+void ParticleWorld::stepImpulses(float duration, bool keepForces)
+{
     // Then integrate the objects
-    integrate(duration);
+    {
+        PROFILE_SCOPE(profiler, PHASE_INTEGRATE);
+        integrate(duration, false, keepForces);
+    }
+
+    // Find the particles that are close enough to collide
+    {
+        PROFILE_SCOPE(profiler, PHASE_BROADPHASE);
+        broadphase();
+    }
+    framePairs += (unsigned)candidatePairs.size();
 
     // Generate contacts
-    unsigned usedContacts = generateContacts();
+    unsigned usedContacts;
+    {
+        PROFILE_SCOPE(profiler, PHASE_NARROWPHASE);
+        usedContacts = generateContacts();
+    }
+    frameContacts += usedContacts + contacts.getDroppedLastFrame();
+    frameDropped += contacts.getDroppedLastFrame();
+    ParticleContact *contactArray = contacts.data();
 
-    // And process them
-    if (usedContacts)
+    // Wake anything that has been hit, and skip what is still asleep
+    if (sleeping)
     {
-        if (calculateIterations) resolver.setIterations(usedContacts * 2);
-        resolver.resolveContacts(contacts, usedContacts, duration);
+        PROFILE_SCOPE(profiler, PHASE_SLEEP);
+        usedContacts = wakeContacts(contactArray, usedContacts, duration);
     }
+
+    {
+        PROFILE_SCOPE(profiler, PHASE_RESOLVE);
+
+        // Start each contact from last frame's impulse, or from zero
+        bool cached = warmStarting && resolverMode != RESOLVE_JACOBI;
+        if (cached) contactCache.warmStart(contactArray, usedContacts);
+        else
+        {
+            for (unsigned i = 0; i < usedContacts; i++) contactArray[i].accumulatedImpulse = 0;
+        }
+
+        // And process them. The islands are found even when there
+        // are no contacts, so island sleeping never sees stale ones.
+        if (resolverMode == RESOLVE_ISLANDS)
+        {
+            islands.resolveContacts(contactArray, usedContacts, duration);
+        }
+        else if (usedContacts)
+        {
+            if (resolverMode == RESOLVE_COLOURED)
+            {
+                colouredResolver.resolveContacts(contactArray, usedContacts, duration);
+                resolver.resolveInterpenetration(contactArray, usedContacts);
+            }
+            else if (resolverMode == RESOLVE_JACOBI)
+            {
+                jacobiResolver.resolveContacts(contactArray, usedContacts, duration);
+                resolver.resolveInterpenetration(contactArray, usedContacts);
+            }
+            else if (resolverMode == RESOLVE_INDEXED)
+            {
+                if (calculateIterations) heapResolver.setIterations(usedContacts * 2);
+                heapResolver.resolveContacts(contactArray, usedContacts, duration);
+            }
+            else
+            {
+                if (calculateIterations) resolver.setIterations(usedContacts * 2);
+                resolver.resolveContacts(contactArray, usedContacts, duration);
+            }
+        }
+
+        // Remember the impulses for next frame
+        if (cached) contactCache.update(contactArray, usedContacts);
+    }
+    if (usedContacts) frameIterations += getResolverIterationsUsed();
 }
 
-ParticleWorld::Particles& ParticleWorld::getParticles()
+float ParticleWorld::findTravel(float duration)
 {
-    return particles;
+    // How far each particle can get in the frame with its current
+    // velocity and acceleration, forces included. Fixed and sleeping
+    // particles go nowhere.
+    unsigned count = store.size();
+    travel.resize(count);
+    float maxAccelerationSquared = 0;
+    for (unsigned i = 0; i < count; i++)
+    {
+        float inverseMass = store.inverseMass[i];
+        if (inverseMass <= 0 || !store.awake[i])
+        {
+            travel[i] = 0;
+            continue;
+        }
+
+        float speed = sqrt(store.velocityX[i] * store.velocityX[i] +
+            store.velocityY[i] * store.velocityY[i]);
+        float accelerationX = store.accelerationX[i] + store.forceAccumX[i] * inverseMass;
+        float accelerationY = store.accelerationY[i] + store.forceAccumY[i] * inverseMass;
+        float accelerationSquared = accelerationX * accelerationX + accelerationY * accelerationY;
+        if (accelerationSquared > maxAccelerationSquared) maxAccelerationSquared = accelerationSquared;
+        travel[i] = (speed + sqrt(accelerationSquared) * duration) * duration;
+    }
+    return sqrt(maxAccelerationSquared);
+}
+
+unsigned ParticleWorld::findStepCount(float duration) const
+{
+    // Compare speed against radius particle by particle, rather than
+    // the fastest speed against the smallest radius, so a fast large
+    // particle doesn't split the frame for a slow small one
+    float maxRateSquared = 0;
+    unsigned count = store.size();
+    for (unsigned i = 0; i < count; i++)
+    {
+        float radius = store.radius[i];
+        if (store.inverseMass[i] <= 0 || !store.awake[i] || radius <= 0) continue;
+
+        float speedSquared = store.velocityX[i] * store.velocityX[i] +
+            store.velocityY[i] * store.velocityY[i];
+        float rateSquared = speedSquared / (radius * radius);
+        if (rateSquared > maxRateSquared) maxRateSquared = rateSquared;
+    }
+
+    float steps = ceil(sqrt(maxRateSquared) * duration / stepFraction);
+    if (steps <= 1) return 1;
+    if (steps >= (float)maxStepCount) return maxStepCount > 0 ? maxStepCount : 1;
+    return (unsigned)steps;
+}
+
+void ParticleWorld::stepPositions(float duration, unsigned substeps)
+{
+    float substep = duration / substeps;
+    float inverseSubstep = 1.0f / substep;
+    unsigned count = store.size();
+
+    // The pairs are found once for the whole frame, with each box
+    // grown by as far as its particle can travel in it
+    float maxAcceleration;
+    {
+        PROFILE_SCOPE(profiler, PHASE_BROADPHASE);
+        maxAcceleration = findTravel(duration);
+        grid.setMargins(&travel);
+        sweep.setMargins(&travel);
+        broadphase();
+        grid.setMargins(0);
+        sweep.setMargins(0);
+    }
+    framePairs += (unsigned)candidatePairs.size();
+
+    // Contacts closing slower than a couple of substeps of the
+    // strongest acceleration are resting, and don't bounce
+    float restingSpeed = 2.0f * maxAcceleration * substep;
+
+    // Contacts are generated a little before the particles touch, so
+    // a particle pushed into a neighbour while solving already has a
+    // contact with it. Each particle's margin is its travel over one
+    // substep, but never so small that a stack of particles resting
+    // on each other loses touch.
+    contactMargin.resize(count);
+    for (unsigned i = 0; i < count; i++)
+    {
+        contactMargin[i] = SPECULATIVE_MARGIN_FLOOR + travel[i] / substeps;
+    }
+
+    for (unsigned s = 0; s < substeps; s++)
+    {
+        // Predict where everything goes, keeping the forces for the
+        // later substeps
+        previousX.assign(store.positionX.begin(), store.positionX.end());
+        previousY.assign(store.positionY.begin(), store.positionY.end());
+        {
+            PROFILE_SCOPE(profiler, PHASE_INTEGRATE);
+            integrate(substep, true, true);
+        }
+
+        // The generators only see touching particles, so they are
+        // run with every radius grown by the margin, and the contacts
+        // given back their true (possibly negative) penetration
+        unsigned usedContacts;
+        {
+            PROFILE_SCOPE(profiler, PHASE_NARROWPHASE);
+            savedRadius.assign(store.radius.begin(), store.radius.end());
+            for (unsigned i = 0; i < count; i++) store.radius[i] += contactMargin[i];
+            usedContacts = generateContacts();
+            store.radius.swap(savedRadius);
+
+            ParticleContact *contactArray = contacts.data();
+            for (unsigned i = 0; i < usedContacts; i++)
+            {
+                ParticleContact &contact = contactArray[i];
+                contact.penetration -= contactMargin[contact.particle[0]->getIndex()];
+                if (contact.particle[1]) contact.penetration -= contactMargin[contact.particle[1]->getIndex()];
+            }
+        }
+        frameContacts += usedContacts + contacts.getDroppedLastFrame();
+        frameDropped += contacts.getDroppedLastFrame();
+        ParticleContact *contactArray = contacts.data();
+
+        if (sleeping)
+        {
+            PROFILE_SCOPE(profiler, PHASE_SLEEP);
+            usedContacts = wakeContacts(contactArray, usedContacts, substep);
+        }
+
+        PROFILE_SCOPE(profiler, PHASE_RESOLVE);
+
+        // Remember how fast each contact was closing before it was
+        // pushed apart, for the bounce
+        closingSpeed.resize(usedContacts);
+        for (unsigned i = 0; i < usedContacts; i++)
+        {
+            closingSpeed[i] = contactArray[i].calculateSeparatingVelocity();
+        }
+
+        // Solve the contacts as position constraints. The ones still
+        // apart are left alone, unless the solve pushes them together.
+        positionResolver.resolvePositions(contactArray, usedContacts);
+        frameIterations += positionResolver.getPositionIterationsUsed();
+
+        // The velocity is whatever moved the particles there. That
+        // includes the sleepers woken this substep, which weren't
+        // integrated but were moved by the solve.
+        for (unsigned i = 0; i < count; i++)
+        {
+            if (!store.awake[i] || store.inverseMass[i] == 0) continue;
+            store.velocityX[i] = (store.positionX[i] - previousX[i]) * inverseSubstep;
+            store.velocityY[i] = (store.positionY[i] - previousY[i]) * inverseSubstep;
+        }
+
+        // Pushing the particles apart leaves them separating as fast
+        // as they were pushed, which would feed energy into a pile.
+        // Instead each contact separates as an impulse would have
+        // left it: at its restitution if it was closing fast, not at
+        // all if it was resting, and as before if it was separating.
+        float touching = -positionResolver.getPenetrationTolerance();
+        for (unsigned i = 0; i < usedContacts; i++)
+        {
+            if (contactArray[i].penetration < touching) continue;
+
+            float closing = closingSpeed[i];
+            float target = closing > 0 ? closing : 0;
+            if (closing < -restingSpeed) target = -contactArray[i].restitution * closing;
+            contactArray[i].setSeparatingVelocity(target);
+        }
+
+        // A sleeper woken in this substep moves in the next one
+        restorePinnedParticles();
+    }
+
+    // The forces have been used for every substep now
+    clearForces();
+}
+
+void ParticleWorld::clearForces()
+{
+    unsigned count = store.size();
+    if (count == 0) return;
+    memset(&store.forceAccumX[0], 0, count * sizeof(float));
+    memset(&store.forceAccumY[0], 0, count * sizeof(float));
+}
+
+unsigned ParticleWorld::wakeContacts(ParticleContact *contactArray, unsigned numContacts, float duration)
+{
+    // A sleeping particle is woken by an awake one running into it
+    // faster than the sleep energy allows. The closing speed the
+    // mover's own acceleration added this step doesn't count, so one
+    // resting on it under gravity can fall asleep in turn rather
+    // than keeping it awake.
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        const ParticleContact &contact = contactArray[i];
+        if (!contact.particle[1]) continue;
+
+        unsigned a = contact.particle[0]->getIndex();
+        unsigned b = contact.particle[1]->getIndex();
+        if (store.awake[a] == store.awake[b]) continue;
+
+        unsigned mover = store.awake[a] ? a : b;
+        unsigned sleeper = store.awake[a] ? b : a;
+        float closing = -contact.calculateSeparatingVelocity();
+        float pushed = (store.accelerationX[mover] * contact.contactNormal.x +
+            store.accelerationY[mover] * contact.contactNormal.y) * duration;
+        closing -= mover == a ? -pushed : pushed;
+        if (closing > 0 && 0.5f * closing * closing > sleepEnergy)
+        {
+            store.awake[sleeper] = true;
+            store.sleepTime[sleeper] = 0;
+        }
+    }
+
+    // Contacts with only sleeping particles in them are left alone.
+    // In the rest, a sleeping particle holds still like the scenery.
+    unsigned kept = 0;
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        const ParticleContact &contact = contactArray[i];
+        bool awake = store.awake[contact.particle[0]->getIndex()] != 0;
+        if (contact.particle[1]) awake = awake || store.awake[contact.particle[1]->getIndex()];
+        if (!awake) continue;
+
+        for (unsigned p = 0; p < 2; p++)
+        {
+            if (!contact.particle[p]) continue;
+            unsigned index = contact.particle[p]->getIndex();
+            if (store.awake[index] || store.inverseMass[index] == 0) continue;
+
+            pinnedParticles.push_back(index);
+            pinnedInverseMass.push_back(store.inverseMass[index]);
+            store.inverseMass[index] = 0;
+        }
+
+        if (kept != i) contactArray[kept] = contact;
+        kept++;
+    }
+    return kept;
+}
+
+void ParticleWorld::restorePinnedParticles()
+{
+    for (unsigned i = 0; i < pinnedParticles.size(); i++)
+    {
+        store.inverseMass[pinnedParticles[i]] = pinnedInverseMass[i];
+    }
+    pinnedParticles.clear();
+    pinnedInverseMass.clear();
+}
+
+void ParticleWorld::updateSleep(float duration)
+{
+    restorePinnedParticles();
+
+    // Smooth the velocities over roughly one window
+    float blend = duration / (duration + sleepWindow);
+
+    // Islands can sleep together, in which case only particles outside
+    // them are put to sleep straight away
+    bool byIsland = islandSleeping && resolverMode == RESOLVE_ISLANDS;
+    if (byIsland) islandReady.assign(islands.getIslandCount(), true);
+
+    const Particles &particles = store.getHandles();
+    unsigned count = store.size();
+    awakeCount = 0;
+    for (unsigned i = 0; i < count; i++)
+    {
+        if (!store.awake[i]) continue;
+        awakeCount++;
+
+        store.averageVelocityX[i] += (store.velocityX[i] - store.averageVelocityX[i]) * blend;
+        store.averageVelocityY[i] += (store.velocityY[i] - store.averageVelocityY[i]) * blend;
+        if (store.inverseMass[i] <= 0) continue;
+
+        float speedSquared = store.averageVelocityX[i] * store.averageVelocityX[i] +
+            store.averageVelocityY[i] * store.averageVelocityY[i];
+        if (0.5f * speedSquared > sleepEnergy) store.sleepTime[i] = 0;
+        else store.sleepTime[i] += duration;
+        bool ready = store.sleepTime[i] >= sleepWindow;
+
+        unsigned island = byIsland ? islands.getIsland(i) : (unsigned)ParticleIslands::NO_ISLAND;
+        if (island != ParticleIslands::NO_ISLAND)
+        {
+            if (!ready) islandReady[island] = false;
+        }
+        else if (ready)
+        {
+            particles[i]->setAwake(false);
+            awakeCount--;
+        }
+    }
+    if (!byIsland) return;
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        if (!store.awake[i]) continue;
+
+        unsigned island = islands.getIsland(i);
+        if (island == ParticleIslands::NO_ISLAND || !islandReady[island]) continue;
+
+        particles[i]->setAwake(false);
+        awakeCount--;
+    }
+}
+
+Particle* ParticleWorld::createParticle()
+{
+    return store.create();
+}
+
+const ParticleWorld::Particles& ParticleWorld::getParticles() const
+{
+    return store.getHandles();
+}
+
+ParticleStore& ParticleWorld::getParticleStore()
+{
+    return store;
 }
 
 ParticleWorld::ContactGenerators& ParticleWorld::getContactGenerators()
 {
     return contactGenerators;
 }
+
+const ParticleWorld::ParticlePairs& ParticleWorld::getCandidatePairs() const
+{
+    return candidatePairs;
+}
+
+void ParticleWorld::setThreadCount(unsigned threadCount)
+{
+    workers.setThreadCount(threadCount);
+}
+
+WorkerPool& ParticleWorld::getWorkerPool()
+{
+    return workers;
+}
+
+void ParticleWorld::setParallelContactGeneration(bool parallel)
+{
+    parallelContacts = parallel;
+}
+
+void ParticleWorld::setContactLimit(unsigned limit)
+{
+    contactLimit = limit;
+}
+
+const ParticleContactArena& ParticleWorld::getContactArena() const
+{
+    return contacts;
+}
+
+void ParticleWorld::setWarmStarting(bool warmStarting)
+{
+    ParticleWorld::warmStarting = warmStarting;
+    if (!warmStarting) contactCache.clear();
+}
+
+void ParticleWorld::setVelocityTolerance(float tolerance)
+{
+    resolver.setVelocityTolerance(tolerance);
+    heapResolver.setVelocityTolerance(tolerance);
+    colouredResolver.setVelocityTolerance(tolerance);
+    jacobiResolver.setVelocityTolerance(tolerance);
+    islands.setVelocityTolerance(tolerance);
+}
+
+ParticleContactCache& ParticleWorld::getContactCache()
+{
+    return contactCache;
+}
+
+unsigned ParticleWorld::getIterationsUsed() const
+{
+    return frameIterations;
+}
+
+unsigned ParticleWorld::getPairCount() const
+{
+    return framePairs;
+}
+
+unsigned ParticleWorld::getResolverIterationsUsed() const
+{
+    if (resolverMode == RESOLVE_COLOURED) return colouredResolver.getIterationsUsed();
+    if (resolverMode == RESOLVE_JACOBI) return jacobiResolver.getIterationsUsed();
+    if (resolverMode == RESOLVE_INDEXED) return heapResolver.getIterationsUsed();
+    if (resolverMode == RESOLVE_ISLANDS) return islands.getIterationsUsed();
+    return resolver.getIterationsUsed();
+}
+
+void ParticleWorld::setSleeping(bool sleeping)
+{
+    ParticleWorld::sleeping = sleeping;
+    if (sleeping) return;
+
+    for (unsigned i = 0; i < store.size(); i++)
+    {
+        store.awake[i] = true;
+        store.sleepTime[i] = 0;
+    }
+}
+
+void ParticleWorld::setSleepEnergy(float energy)
+{
+    sleepEnergy = energy;
+}
+
+void ParticleWorld::setSleepWindow(float window)
+{
+    sleepWindow = window;
+}
+
+void ParticleWorld::setIslandSleeping(bool islandSleeping)
+{
+    ParticleWorld::islandSleeping = islandSleeping;
+}
+
+unsigned ParticleWorld::getAwakeCount() const
+{
+    return awakeCount;
+}
+
+void ParticleWorld::setBroadphaseMode(BroadphaseMode mode)
+{
+    broadphaseMode = mode;
+}
+
+void ParticleWorld::setResolverMode(ResolverMode mode)
+{
+    resolverMode = mode;
+}
+
+void ParticleWorld::setStepMode(StepMode mode)
+{
+    stepMode = mode;
+}
+
+ParticleWorld::StepMode ParticleWorld::getStepMode() const
+{
+    return stepMode;
+}
+
+void ParticleWorld::setSubsteps(unsigned substeps)
+{
+    substepCount = substeps;
+}
+
+unsigned ParticleWorld::getSubsteps() const
+{
+    return substepCount;
+}
+
+void ParticleWorld::setAdaptiveStepping(float fraction, unsigned maxSteps)
+{
+    stepFraction = fraction;
+    maxStepCount = maxSteps;
+}
+
+float ParticleWorld::getStepFraction() const
+{
+    return stepFraction;
+}
+
+unsigned ParticleWorld::getStepCount() const
+{
+    return stepCount;
+}
+
+ParticleContactResolver& ParticleWorld::getPositionResolver()
+{
+    return positionResolver;
+}
+
+void ParticleWorld::setIntegratorMode(IntegratorMode mode)
+{
+    integratorMode = mode;
+}
+
+ParticleWorld::IntegratorMode ParticleWorld::getIntegratorMode() const
+{
+    return integratorMode;
+}
+
+ParticleColouredResolver& ParticleWorld::getColouredResolver()
+{
+    return colouredResolver;
+}
+
+ParticleJacobiResolver& ParticleWorld::getJacobiResolver()
+{
+    return jacobiResolver;
+}
+
+ParticleIslands& ParticleWorld::getIslands()
+{
+    return islands;
+}
+
+bool ParticleWorld::publishSnapshot(double stamp)
+{
+    return snapshots.publish(store, stamp);
+}
+
+const ParticleSnapshot* ParticleWorld::acquireSnapshot()
+{
+    return snapshots.acquire();
+}
+
+void ParticleWorld::releaseSnapshot(const ParticleSnapshot *snapshot)
+{
+    snapshots.release(snapshot);
+}
+
+const ParticleSnapshotBuffer& ParticleWorld::getSnapshotBuffer() const
+{
+    return snapshots;
+}
+
+ParticleProfiler& ParticleWorld::getProfiler()
+{
+    return profiler;
+}